@@ -19,8 +19,62 @@ from matplotlib.figure import Figure
 import matplotlib as mpl
 import numpy as np
 import csv
+import struct
 from collections import deque
 
+# Binary telemetry framing (must match PID_Tune.h)
+FRAME_SYNC = 0xA5
+FRAME_DATA = 0x01
+FRAME_CAPTURE = 0x02
+FRAME_DELTA = 0x03
+FRAME_OVERHEAD = 6  # sync, len, type, seq + 2 byte CRC
+DATA_FRAME = struct.Struct('<Iffffff')  # time, pv, sp, output, P, I, D
+DELTA_FIELDS = ('pv', 'sp', 'output', 'P', 'I', 'D')  # Mask bits 0-5 of a delta frame
+DELTA_RESOLUTION = 0.01  # PID_TUNE_DELTA_RESOLUTION
+
+def crc16_ccitt(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE as used by PID_Tune::sendFrame()"""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+def decode_frame(frame_type, seq, payload, refs=None):
+    """Convert a binary frame into the same dict shape as the JSON messages.
+    refs holds the last data frame per loop, which delta frames are applied to."""
+    if frame_type == FRAME_DATA and len(payload) in (DATA_FRAME.size, DATA_FRAME.size + 1):
+        t, pv, sp, output, P, I, D = DATA_FRAME.unpack(payload[:DATA_FRAME.size])
+        msg = {'type': 'data', 'seq': seq, 'time': t, 'pv': pv, 'sp': sp,
+               'output': output, 'error': sp - pv, 'P': P, 'I': I, 'D': D}
+        if len(payload) > DATA_FRAME.size:
+            msg['loop'] = payload[DATA_FRAME.size]  # Sent by PID_Group firmware
+        if refs is not None:
+            refs[msg.get('loop')] = dict(msg)
+        return msg
+    if frame_type == FRAME_DELTA and len(payload) >= 3 and refs is not None:
+        mask = payload[0]
+        fields = [name for bit, name in enumerate(DELTA_FIELDS) if mask & (1 << bit)]
+        size = 3 + 2 * len(fields)
+        if len(payload) not in (size, size + 1):
+            return None
+        loop = payload[size] if len(payload) > size else None
+        ref = refs.get(loop)
+        if ref is None:
+            return None  # No full frame for this loop yet
+        ref['time'] += payload[1] | (payload[2] << 8)
+        for name, step in zip(fields, struct.unpack_from('<%dh' % len(fields), payload, 3)):
+            ref[name] += step * DELTA_RESOLUTION
+        ref['error'] = ref['sp'] - ref['pv']
+        ref['seq'] = seq
+        return dict(ref)
+    if frame_type == FRAME_CAPTURE and len(payload) >= 2 and (len(payload) - 2) % DATA_FRAME.size == 0:
+        index = payload[0] | (payload[1] << 8)
+        samples = [list(s) for s in DATA_FRAME.iter_unpack(payload[2:])]
+        return {'type': 'capture', 'seq': seq, 'index': index, 'samples': samples}
+    return None
+
 # Custom dark dropdown class to replace stubborn combobox
 class DarkDropdown(tk.Menubutton):
     def __init__(self, master, textvariable=None, values=None, width=None, state='normal', **kwargs):
@@ -154,12 +208,13 @@ class StepResponseAnalyzer:
         self.output.append(output)
         
     def analyze(self):
-        if len(self.time) < 10:
+        if len(self.time) < 3:
             return None
             
         # Find step start
         for i in range(1, len(self.sp)):
             if abs(self.sp[i] - self.sp[i-1]) > 0.1:
+                step_idx = i
                 self.step_start_time = self.time[i]
                 self.initial_value = np.mean(self.pv[max(0, i-10):i])
                 self.final_value = self.sp[i]
@@ -178,7 +233,7 @@ class StepResponseAnalyzer:
         rise_start_idx = None
         rise_end_idx = None
         
-        for i in range(int(self.step_start_time * 10), len(self.pv)):
+        for i in range(step_idx, len(self.pv)):
             if rise_start_idx is None and self.pv[i] >= rise_10:
                 rise_start_idx = i
             if rise_end_idx is None and self.pv[i] >= rise_90:
@@ -189,12 +244,12 @@ class StepResponseAnalyzer:
             metrics['rise_time'] = (self.time[rise_end_idx] - self.time[rise_start_idx])
             
         # Overshoot
-        max_pv = max(self.pv[int(self.step_start_time * 10):])
+        max_pv = max(self.pv[step_idx:])
         metrics['overshoot'] = ((max_pv - self.final_value) / self.step_amplitude) * 100
         
         # Settling time (within 2% of final value)
         settling_band = 0.02 * self.step_amplitude
-        for i in range(len(self.pv) - 1, int(self.step_start_time * 10), -1):
+        for i in range(len(self.pv) - 1, step_idx, -1):
             if abs(self.pv[i] - self.final_value) > settling_band:
                 metrics['settling_time'] = self.time[i] - self.step_start_time
                 break
@@ -208,6 +263,9 @@ class StepResponseAnalyzer:
         return metrics
 
 class PIDTuningApp:
+    # Step response metrics reported in "step_test_complete"
+    DEVICE_STEP_METRICS = ('rise_time', 'overshoot', 'settling_time', 'steady_state_error', 'iae', 'ise')
+    
     def __init__(self, root):
         self.root = root
         self.root.title("PID Tuning Application - Version 1.0.0")
@@ -234,11 +292,22 @@ class PIDTuningApp:
         # Step response analysis
         self.analyzer = StepResponseAnalyzer()
         self.step_test_active = False
+        self.device_step_metrics = {}
+        self.autotune_active = False
+        self.capture_time_scale = 1e-3  # Capture timestamps are ms unless the firmware says us
         
         # Serial connection
         self.serial_port = None
         self.serial_thread = None
         self.running = False
+        self.use_binary_telemetry = True  # Ask the device for binary frames on connect
+        self.last_frame_seq = None
+        self.dropped_frames = 0
+        self.delta_refs = {}  # Last data frame per loop, for delta frames
+        
+        # Loop selection for PID_Group firmware (a single loop otherwise)
+        self.loop_id_var = tk.IntVar(value=0)
+        self.loop_count = 1
         
         # Current values with formatted display
         self.current_pv = tk.DoubleVar(value=0.0)
@@ -265,6 +334,11 @@ class PIDTuningApp:
         
         # Control loop period
         self.loop_period_var = tk.IntVar(value=100)  # Default 100ms
+        self.device_period_us = None  # Exact period from the last status, for sub-ms loops
+        
+        # Telemetry rate
+        self.data_interval_var = tk.IntVar(value=100)  # Default 100ms (10Hz)
+        self.adaptive_rate_var = tk.BooleanVar(value=False)
         
         # Anti-windup settings
         self.anti_windup_enabled = tk.BooleanVar(value=True)
@@ -406,6 +480,14 @@ class PIDTuningApp:
         self.connect_btn.grid(row=row, column=0, columnspan=4, sticky=(tk.W, tk.E), pady=(5, 15))
         row += 1
         
+        # Loop selection, populated when the firmware reports a PID_Group
+        ttk.Label(control_frame, text="Loop:").grid(row=row, column=0, sticky=tk.W)
+        self.loop_combo = DarkDropdown(control_frame, textvariable=self.loop_id_var, values=[0],
+                                       width=80, state='readonly', text="0")
+        self.loop_combo.grid(row=row, column=1, sticky=tk.W, padx=(5, 0), pady=(0, 10))
+        self.loop_id_var.trace_add('write', lambda *args: self.send_command("get_status"))
+        row += 1
+        
         ttk.Separator(control_frame, orient='horizontal').grid(row=row, column=0, columnspan=4, sticky=(tk.W, tk.E), pady=10)
         row += 1
         
@@ -511,6 +593,16 @@ class PIDTuningApp:
         def update_loop_period_display(*args):
             self.loop_period_display.set(f"{self.loop_period_var.get()} ms")
         self.loop_period_var.trace_add('write', update_loop_period_display)
+        
+        # Telemetry rate
+        ttk.Label(params_frame, text="Data Interval:").grid(row=2, column=0, sticky=tk.W, pady=(5, 0))
+        interval_combo = DarkDropdown(params_frame, textvariable=self.data_interval_var,
+                                     values=[1, 2, 5, 10, 20, 50, 100, 200, 500, 1000],
+                                     width=80, state='readonly',
+                                     text=str(self.data_interval_var.get()))
+        interval_combo.grid(row=2, column=1, sticky=tk.W, padx=(5, 10), pady=(5, 0))
+        ttk.Checkbutton(params_frame, text="Adaptive (skip when link is busy)",
+                        variable=self.adaptive_rate_var).grid(row=2, column=2, columnspan=4, sticky=tk.W, pady=(5, 0))
         row += 1
         
         # Anti-windup settings (now part of PID Configuration)
@@ -569,6 +661,14 @@ class PIDTuningApp:
         
         self.stop_btn = ttk.Button(center_frame, text="■ Stop", command=self.stop_control, state='disabled')
         self.stop_btn.pack(side=tk.LEFT, padx=5)
+        
+        self.autotune_btn = ttk.Button(center_frame, text="Autotune", command=self.toggle_autotune, state='disabled')
+        self.autotune_btn.pack(side=tk.LEFT, padx=5)
+        
+        # Persist the current parameters on the device (firmware with PID_Storage)
+        self.save_device_btn = ttk.Button(center_frame, text="Save to Device",
+                                          command=lambda: self.send_command("save"), state='disabled')
+        self.save_device_btn.pack(side=tk.LEFT, padx=5)
         row += 1
         
         ttk.Separator(control_frame, orient='horizontal').grid(row=row, column=0, columnspan=4, sticky=(tk.W, tk.E), pady=10)
@@ -983,10 +1083,17 @@ for your specific application.
             # Enable control buttons with correct initial states
             self.start_btn.config(state='normal')
             self.stop_btn.config(state='disabled')  # Initially stopped
+            self.autotune_btn.config(state='normal')
+            self.save_device_btn.config(state='normal')
             
             # Request initial status
             self.send_command("get_status")
             
+            # Negotiate compact binary telemetry; older firmware just answers "Unknown command"
+            # and keeps sending JSON, which the reader handles as well
+            if self.use_binary_telemetry:
+                self.send_command("set_format", format="binary")
+            
         except Exception as e:
             messagebox.showerror("Connection Error", str(e))
             
@@ -1002,39 +1109,85 @@ for your specific application.
         # Disable control buttons
         self.start_btn.config(state='disabled')
         self.stop_btn.config(state='disabled')
+        self.autotune_btn.config(state='disabled', text="Autotune")
+        self.save_device_btn.config(state='disabled')
+        self.autotune_active = False
         
     def serial_read_thread(self):
-        buffer = ""
+        buffer = bytearray()
         while self.serial_port and self.serial_port.is_open:
             try:
                 if self.serial_port.in_waiting:
-                    data = self.serial_port.read(self.serial_port.in_waiting).decode('utf-8')
-                    buffer += data
-                    
-                    while '\n' in buffer:
-                        line, buffer = buffer.split('\n', 1)
-                        line = line.strip()
-                        if line:
-                            try:
-                                msg = json.loads(line)
-                                # Only add valid JSON messages with 'type' field
-                                if isinstance(msg, dict) and 'type' in msg:
-                                    self.data_queue.put(msg)
-                            except json.JSONDecodeError as e:
-                                print(f"JSON decode error: {e} - Line: {line}")
-                            except Exception as e:
-                                print(f"Error processing message: {e} - Line: {line}")
+                    buffer += self.serial_port.read(self.serial_port.in_waiting)
+                    self.extract_messages(buffer)
+                else:
+                    time.sleep(0.001)
                                 
             except Exception as e:
                 print(f"Serial error: {e}")
                 break
                 
+    def extract_messages(self, buffer):
+        """Pull complete JSON lines and binary frames out of buffer (modified in place)"""
+        while buffer:
+            if buffer[0] == FRAME_SYNC:
+                if len(buffer) < 2:
+                    return
+                frame_len = buffer[1] + FRAME_OVERHEAD
+                if len(buffer) < frame_len:
+                    return
+                frame = bytes(buffer[:frame_len])
+                crc = frame[-2] | (frame[-1] << 8)
+                if crc16_ccitt(frame[1:-2]) != crc:
+                    # Not a valid frame - resynchronise on the next byte
+                    del buffer[0]
+                    continue
+                del buffer[:frame_len]
+                seq = frame[3]
+                if self.last_frame_seq is not None:
+                    lost = (seq - self.last_frame_seq - 1) & 0xFF
+                    if lost:
+                        self.dropped_frames += lost
+                        self.delta_refs.clear()  # Deltas wait for the next full frame
+                self.last_frame_seq = seq
+                msg = decode_frame(frame[2], seq, frame[4:-2], self.delta_refs)
+                if msg:
+                    self.data_queue.put(msg)
+                continue
+                
+            # Text line - stop at a newline, or at a sync byte when a frame follows text directly
+            end = buffer.find(b'\n')
+            sync = buffer.find(bytes([FRAME_SYNC]))
+            if end < 0 and sync < 0:
+                return
+            if end < 0 or 0 <= sync < end:
+                line_bytes, consumed = buffer[:sync], sync
+            else:
+                line_bytes, consumed = buffer[:end], end + 1
+            del buffer[:consumed]
+            
+            line = line_bytes.decode('utf-8', errors='replace').strip()
+            if line:
+                try:
+                    msg = json.loads(line)
+                    # Only add valid JSON messages with 'type' field
+                    if isinstance(msg, dict) and 'type' in msg:
+                        self.data_queue.put(msg)
+                except json.JSONDecodeError as e:
+                    print(f"JSON decode error: {e} - Line: {line}")
+                except Exception as e:
+                    print(f"Error processing message: {e} - Line: {line}")
+                
     def process_data(self):
         try:
             while True:
                 msg = self.data_queue.get_nowait()
                 
                 if msg['type'] == 'data':
+                    # Ignore samples from a loop that's no longer selected
+                    if msg.get('loop', self.loop_id_var.get()) != self.loop_id_var.get():
+                        continue
+                        
                     # Update current values
                     pv = msg['pv']
                     sp = msg['sp']
@@ -1092,6 +1245,21 @@ for your specific application.
                     if 'loop_period' in msg:
                         self.loop_period_var.set(msg['loop_period'])
                         self.loop_period_display.set(f"{msg['loop_period']} ms")
+                    if 'loop_period_us' in msg:
+                        self.device_period_us = msg['loop_period_us']
+                        self.loop_period_display.set(f"{self.device_period_us / 1000:g} ms")
+                    
+                    # Update loop selection for group firmware
+                    if 'loops' in msg and msg['loops'] != self.loop_count:
+                        self.loop_count = msg['loops']
+                        self.loop_combo.values = list(range(self.loop_count))
+                        self.loop_combo._build_menu()
+                    
+                    # Update telemetry rate display
+                    if 'data_interval' in msg:
+                        self.data_interval_var.set(msg['data_interval'])
+                    if 'adaptive' in msg:
+                        self.adaptive_rate_var.set(msg['adaptive'])
                     
                     # Update anti-windup settings
                     if 'anti_windup' in msg:
@@ -1124,7 +1292,63 @@ for your specific application.
                     
                 elif msg['type'] == 'step_test_complete':
                     self.step_test_active = False
-                    self.status_var.set("Step test complete")
+                    # Newer firmware computes the metrics itself at full loop rate
+                    self.device_step_metrics = {k: msg[k] for k in self.DEVICE_STEP_METRICS if msg.get(k) is not None}
+                    if self.device_step_metrics:
+                        self.status_var.set(f"Step test - {self.format_metrics(self.device_step_metrics)}")
+                    else:
+                        self.status_var.set("Step test complete")
+                    # Fetch the full-rate on-device capture if the firmware recorded one
+                    if msg.get('captured', 0) > 0:
+                        self.send_command("dump_capture")
+                        
+                elif msg['type'] == 'autotune_started':
+                    self.autotune_active = True
+                    self.autotune_btn.config(text="Stop Autotune")
+                    self.status_var.set("Autotune running...")
+                    
+                elif msg['type'] == 'autotune_complete':
+                    self.autotune_active = False
+                    self.autotune_btn.config(text="Autotune")
+                    self.kp_var.set(round(msg['kp'], 4))
+                    self.ki_var.set(round(msg['ki'], 4))
+                    self.kd_var.set(round(msg['kd'], 4))
+                    self.status_var.set(f"Autotune ({msg.get('rule', 'zn')}): Ku {msg['ku']:.3f}, Tu {msg['tu']:.3f} s")
+                    
+                elif msg['type'] == 'autotune_failed':
+                    self.autotune_active = False
+                    self.autotune_btn.config(text="Autotune")
+                    self.status_var.set(f"Autotune failed: {msg.get('reason', 'unknown')}")
+                    
+                elif msg['type'] == 'saved':
+                    if msg.get('written'):
+                        self.status_var.set(f"Parameters saved to device (#{msg.get('sequence', 0)})")
+                    else:
+                        self.status_var.set("Device parameters already up to date")
+                    
+                elif msg['type'] == 'schedule':
+                    self.status_var.set(f"Gain schedule loaded ({msg.get('points', 0)} points)")
+                    
+                elif msg['type'] == 'capture_begin':
+                    self.analyzer.reset()
+                    self.capture_time_scale = 1e-6 if msg.get('time_unit') == 'us' else 1e-3
+                    self.status_var.set(f"Downloading capture ({msg.get('count', 0)} samples)...")
+                    
+                elif msg['type'] == 'capture':
+                    for t_raw, pv, sp, output, P, I, D in msg['samples']:
+                        self.analyzer.add_data(t_raw * self.capture_time_scale, pv, sp, output)
+                        
+                elif msg['type'] == 'capture_end':
+                    metrics = self.device_step_metrics or self.analyzer.analyze()
+                    if metrics:
+                        self.status_var.set(f"Step test ({len(self.analyzer.time)} samples) - {self.format_metrics(metrics)}")
+                    else:
+                        self.status_var.set(f"Capture complete ({len(self.analyzer.time)} samples)")
+                    
+                elif msg['type'] == 'format':
+                    self.last_frame_seq = None
+                    self.delta_refs.clear()
+                    self.status_var.set(f"Telemetry format: {msg.get('format', 'json')}")
                     
                 elif msg.get('type') == 'debug':
                     # Handle debug messages
@@ -1193,6 +1417,8 @@ for your specific application.
     def send_command(self, cmd, **kwargs):
         if self.serial_port:
             msg = {"cmd": cmd}
+            if self.loop_count > 1:
+                msg["loop"] = self.loop_id_var.get()
             msg.update(kwargs)
             try:
                 self.serial_port.write((json.dumps(msg) + '\n').encode('utf-8'))
@@ -1200,6 +1426,12 @@ for your specific application.
                 print(f"Send error: {e}")
                 
     def apply_pid(self):
+        # An unchanged period goes back exactly, so a microsecond loop isn't rounded to ms
+        period = self.loop_period_var.get()
+        if self.device_period_us is not None and period == self.device_period_us // 1000:
+            period_field = {'loop_period_us': self.device_period_us}
+        else:
+            period_field = {'loop_period': period}
         self.send_command("set_params", 
                         kp=self.kp_var.get(),
                         ki=self.ki_var.get(),
@@ -1211,8 +1443,11 @@ for your specific application.
                         integral_limit=self.integral_limit_enabled.get(),
                         integral_min=self.integral_min_var.get(),
                         integral_max=self.integral_max_var.get(),
-                        loop_period=self.loop_period_var.get())
+                        **period_field)
         self.send_command("set_sp", value=self.sp_var.get())
+        self.send_command("set_rate",
+                        interval=self.data_interval_var.get(),
+                        adaptive=self.adaptive_rate_var.get())
         
     def reset_pid(self):
         self.kp_var.set(2.0)
@@ -1236,6 +1471,18 @@ for your specific application.
         # Request status to confirm
         self.root.after(100, lambda: self.send_command("get_status"))
         
+    @staticmethod
+    def format_metrics(metrics):
+        return ", ".join(f"{k.replace('_', ' ')}: {v:.2f}" for k, v in metrics.items())
+        
+    def toggle_autotune(self):
+        if self.autotune_active:
+            self.send_command("autotune_stop")
+            return
+        # Relay a quarter of the output range either side of the current output
+        amplitude = 0.25 * (self.output_max_var.get() - self.output_min_var.get())
+        self.send_command("autotune", amplitude=amplitude)
+        
     def step_test(self):
         self.send_command("step_test", amplitude=10.0)
         
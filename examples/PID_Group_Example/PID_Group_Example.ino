@@ -0,0 +1,73 @@
+/**************************************************************************************************
+ * PID_Group Example Sketch
+ * 
+ * Runs several heater zones from one PID_Group. The group reads the clock once per tick,
+ * staggers the zones' sample phases and reads each zone's sensor only when it is due.
+ * A single PID_Tune session tunes any zone - pick it with the Loop selector in the Python app.
+ **************************************************************************************************/
+
+#include <PID_Control.h>
+#include <PID_Group.h>
+#include <PID_Tune.h>
+
+// =========================================================================
+// CONFIGURATION
+// =========================================================================
+
+#define ZONE_COUNT 4
+#define SAMPLE_TIME 200            // PID update time (ms), the same for every zone
+
+const int SENSOR_PINS[ZONE_COUNT] = {A0, A1, A2, A3};
+const int OUTPUT_PINS[ZONE_COUNT] = {3, 5, 6, 9};
+
+// =========================================================================
+// GLOBAL OBJECTS
+// =========================================================================
+
+PID_Control zones[ZONE_COUNT] = {
+    PID_Control(OUTPUT_PINS[0], true),
+    PID_Control(OUTPUT_PINS[1], true),
+    PID_Control(OUTPUT_PINS[2], true),
+    PID_Control(OUTPUT_PINS[3], true)
+};
+
+PID_Group group;
+PID_Tune tuner(group);
+
+// =========================================================================
+// SENSOR READING FUNCTION
+// =========================================================================
+
+// Called by the group with the id of the zone being sampled
+float readZone(uint8_t id) {
+    return analogRead(SENSOR_PINS[id]) * 0.1;
+}
+
+// =========================================================================
+// SETUP
+// =========================================================================
+
+void setup() {
+    for (int i = 0; i < ZONE_COUNT; i++) {
+        zones[i].begin(2.0, 0.1, 0.05, 25.0);  // Kp, Ki, Kd, setpoint
+        zones[i].setSampleTime(SAMPLE_TIME);
+        group.add(zones[i], readZone);          // Ids are assigned in order: 0, 1, 2, ...
+    }
+    
+    // Spread the zones' samples evenly over the sample time
+    group.begin();
+    
+    // Add the loops before starting the tuner, it selects loop 0
+    tuner.begin(Serial, 115200);
+}
+
+// =========================================================================
+// MAIN LOOP
+// =========================================================================
+
+void loop() {
+    tuner.update();
+    
+    // One pass updates every zone that is due
+    group.update();
+}
@@ -0,0 +1,227 @@
+/**************************************************************************************************
+ * PID_Control host benchmarks
+ * 
+ * Updates per second of the float, fixed-point and batch controllers closing the loop around
+ * synthetic plants. The library runs on a simulated clock (PID_Hal) that advances one sample
+ * time per iteration, so every update() computes and the figures exclude waiting.
+ **************************************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <PID_Bank.h>
+#include <PID_Control.h>
+#include <PID_ControlT.h>
+#include <PID_Sim.h>
+#include <PID_Tune.h>
+
+static unsigned long s_micros = 0;
+
+static unsigned long simMillis() {
+    return s_micros / 1000;
+}
+
+static unsigned long simMicros() {
+    return s_micros;
+}
+
+static void nullOutput(int, int) {}
+
+static void useSimClock() {
+    PID_Hal::setClock(simMillis, simMicros);
+    PID_Hal::setOutput(nullOutput);
+}
+
+// First-order lag (thermal-like): y' = (K*u - y) / tau
+struct FirstOrder {
+    float y = 20.0f;
+    float step(float u, float dt) {
+        y += (0.5f * u + 20.0f - y) * dt / 2.0f;
+        return y;
+    }
+};
+
+// Second-order underdamped (motor/position-like): y'' = w^2 (K*u - y) - 2 zeta w y'
+struct SecondOrder {
+    float y = 0.0f;
+    float v = 0.0f;
+    float step(float u, float dt) {
+        const float w = 6.0f;
+        const float zeta = 0.3f;
+        v += (w * w * (0.2f * u - y) - 2.0f * zeta * w * v) * dt;
+        y += v * dt;
+        return y;
+    }
+};
+
+template <typename Plant>
+static void BM_Float(benchmark::State& state) {
+    useSimClock();
+    PID_Control pid(-1, true);
+    pid.begin(2.0f, 0.5f, 0.1f, 30.0f);
+    pid.setSampleTimeUs(1000);
+    pid.setFixedRate(state.range(0) != 0);
+    pid.setVelocityForm(state.range(1) != 0);
+    
+    Plant plant;
+    float pv = plant.y;
+    for (auto _ : state) {
+        s_micros += 1000;
+        pid.update(pv);
+        pv = plant.step(pid.getOutput(), 0.001f);
+    }
+    benchmark::DoNotOptimize(pv);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_Float, FirstOrder)->ArgNames({"fixed_rate", "velocity"})->ArgsProduct({{0, 1}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_Float, SecondOrder)->ArgNames({"fixed_rate", "velocity"})->ArgsProduct({{0, 1}, {0, 1}});
+
+// Fixed point with every compile-time policy stripped, for comparison with the full controller
+using PID_ControlFixedLean = PID_ControlT<q16_16, PID_Safety::None, PID_Derivative::OnMeasurement,
+                                          PID_Output::None, PID_Direction::Direct>;
+
+template <typename Plant, typename Pid = PID_ControlFixed>
+static void BM_Fixed(benchmark::State& state) {
+    useSimClock();
+    Pid pid(-1, true);
+    pid.begin(2.0f, 0.5f, 0.1f, 30.0f);
+    pid.setSampleTime(1);
+    
+    Plant plant;
+    float pv = plant.y;
+    for (auto _ : state) {
+        s_micros += 1000;
+        pid.update(q16_16(pv));
+        pv = plant.step((float)pid.getOutput(), 0.001f);
+    }
+    benchmark::DoNotOptimize(pv);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_Fixed, FirstOrder);
+BENCHMARK_TEMPLATE(BM_Fixed, SecondOrder);
+BENCHMARK_TEMPLATE(BM_Fixed, FirstOrder, PID_ControlFixedLean);
+BENCHMARK_TEMPLATE(BM_Fixed, SecondOrder, PID_ControlFixedLean);
+
+// Items are channel updates, so the figure compares directly with one PID_Control
+template <size_t N>
+static void BM_Bank(benchmark::State& state) {
+    useSimClock();
+    PID_Bank<N> bank;
+    for (size_t ch = 0; ch < N; ch++) {
+        bank.begin(ch, 2.0f, 0.5f, 0.1f, 30.0f);
+    }
+    bank.setSampleTime(1);
+    bank.start();
+    
+    FirstOrder plants[N];
+    float inputs[N];
+    for (size_t ch = 0; ch < N; ch++) inputs[ch] = plants[ch].y;
+    
+    for (auto _ : state) {
+        s_micros += 1000;
+        bank.update(inputs);
+        const float* outputs = bank.getOutputs();
+        for (size_t ch = 0; ch < N; ch++) {
+            inputs[ch] = plants[ch].step(outputs[ch], 0.001f);
+        }
+    }
+    benchmark::DoNotOptimize(inputs);
+    state.SetItemsProcessed(state.iterations() * N);
+}
+BENCHMARK_TEMPLATE(BM_Bank, 8);
+BENCHMARK_TEMPLATE(BM_Bank, 64);
+
+// Bank kernel alone, without the plant
+template <size_t N>
+static void BM_BankCompute(benchmark::State& state) {
+    useSimClock();
+    PID_Bank<N> bank;
+    for (size_t ch = 0; ch < N; ch++) {
+        bank.begin(ch, 2.0f, 0.5f, 0.1f, 30.0f);
+    }
+    float inputs[N];
+    for (size_t ch = 0; ch < N; ch++) inputs[ch] = 20.0f + ch * 0.1f;
+    
+    benchmark::DoNotOptimize(&bank);  // Escape the bank so its stores can't be dropped
+    for (auto _ : state) {
+        bank.compute(inputs);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * N);
+}
+BENCHMARK_TEMPLATE(BM_BankCompute, 64);
+
+// Telemetry cost: one binary or JSON sample per PID_Tune::update() into a sink
+class NullSerial : public HardwareSerial {
+    public:
+        size_t write(uint8_t) override { return 1; }
+        size_t write(const uint8_t*, size_t size) override { return size; }
+        int availableForWrite() override { return 1024; }
+};
+
+static void BM_TuneTelemetry(benchmark::State& state) {
+    useSimClock();
+    PID_Control pid(-1, true);
+    pid.begin(2.0f, 0.5f, 0.1f, 30.0f);
+    pid.setSampleTime(1);
+    
+    NullSerial serial;
+    PID_Tune tuner(pid);
+    tuner.begin(serial, 115200, state.range(0) ? PID_Tune::FORMAT_BINARY : PID_Tune::FORMAT_JSON);
+    tuner.setDataInterval(1);
+    tuner.setSensorCallback([] { return 25.0f; });
+    
+    for (auto _ : state) {
+        s_micros += 1000;
+        pid.update(25.0f);
+        tuner.update();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TuneTelemetry)->ArgName("binary")->Arg(0)->Arg(1);
+
+// Timestamped ADC inputs, 64 per buffer at 10 kHz into a 1 kHz loop: one update() per input
+// against one updateMany() per buffer
+static void BM_TimestampedBatch(benchmark::State& state) {
+    useSimClock();
+    PID_Control pid(-1, true);
+    pid.begin(2.0f, 0.5f, 0.1f, 30.0f);
+    pid.setSampleTimeUs(1000);
+    
+    FirstOrder plant;
+    float inputs[64];
+    uint32_t stamps[64];
+    for (auto _ : state) {
+        for (int i = 0; i < 64; i++) {
+            inputs[i] = plant.step(pid.getOutput(), 0.0001f);
+            stamps[i] = (uint32_t)(s_micros + i * 100);
+        }
+        s_micros += 6400;
+        if (state.range(0)) {
+            pid.updateMany(inputs, stamps, 64);
+        } else {
+            for (int i = 0; i < 64; i++) pid.update(inputs[i], stamps[i]);
+        }
+    }
+    benchmark::DoNotOptimize(plant.y);
+    state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK(BM_TimestampedBatch)->ArgName("batch")->Arg(0)->Arg(1);
+
+// Closed-loop evaluations of one gain set: 60 s of a PID_Sim FOPDT plant at 1 ms steps
+static void BM_SimRun(benchmark::State& state) {
+    PID_Sim sim;
+    sim.setFirstOrder(2.0f, 10.0f, 1.0f);
+    sim.setOffset(20.0f);
+    
+    float iae = 0.0f;
+    for (auto _ : state) {
+        PID_Control pid(-1, true);
+        pid.begin(0.5f, 0.05f, 0.0f, 60.0f);
+        sim.reset();
+        iae = sim.run(pid, 60000);
+    }
+    benchmark::DoNotOptimize(iae);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SimRun);
+
+BENCHMARK_MAIN();
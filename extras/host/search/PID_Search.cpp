@@ -0,0 +1,266 @@
+/**************************************************************************************************
+ * PID_Search - Offline gain search against PID_Sim plants (host build)
+ * Implementation
+ **************************************************************************************************/
+
+#include "PID_Search.h"
+#include <PID_Control.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+// One simulator per thread for the life of the thread, so the clock it owns never dangles
+static PID_Sim& threadSim() {
+    static thread_local PID_Sim sim;
+    return sim;
+}
+
+static bool byCost(const PID_Search::Result& a, const PID_Search::Result& b) {
+    return a.cost < b.cost;
+}
+
+PID_Search::PID_Search() : _evaluations(0) {
+    _ranges[0] = { 0.01f, 10.0f };
+    _ranges[1] = { 0.0f, 1.0f };
+    _ranges[2] = { 0.0f, 10.0f };
+    _overshootWeight = 0.0f;
+    _settlingWeight = 0.0f;
+    _threads = 0;
+}
+
+void PID_Search::setPlant(const Plant& plant) {
+    _plant = plant;
+}
+
+void PID_Search::setTest(const Test& test) {
+    _test = test;
+}
+
+void PID_Search::setRanges(Range kp, Range ki, Range kd) {
+    _ranges[0] = kp;
+    _ranges[1] = ki;
+    _ranges[2] = kd;
+}
+
+void PID_Search::setWeights(float overshoot, float settling) {
+    _overshootWeight = overshoot;
+    _settlingWeight = settling;
+}
+
+void PID_Search::setThreads(unsigned threads) {
+    _threads = threads;
+}
+
+unsigned PID_Search::getThreads() {
+    if (_threads > 0) return _threads;
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+PID_Search::Result PID_Search::evaluate(float kp, float ki, float kd) {
+    PID_Sim& sim = threadSim();
+    sim.setStep(_plant.stepUs);
+    if (_plant.model == PID_Sim::MODEL_SECOND_ORDER) {
+        sim.setSecondOrder(_plant.gain, _plant.naturalFrequency, _plant.damping, _plant.deadTime);
+    } else {
+        sim.setFirstOrder(_plant.gain, _plant.timeConstant, _plant.deadTime);
+    }
+    sim.setNoise(_plant.noise, _plant.seed);
+    sim.setInput(0.0f);
+    sim.setOffset(_plant.offset);
+    sim.begin();
+    
+    PID_Control pid(-1, true);
+    pid.begin(kp, ki, kd, _test.setpoint);
+    pid.setSampleTime(_test.sampleTimeMs);
+    pid.setOutputLimits(_test.outputMin, _test.outputMax);
+    sim.attach(pid);
+    
+    // Error and overshoot in the direction of the step
+    float step = _test.setpoint - _plant.offset;
+    float direction = step < 0.0f ? -1.0f : 1.0f;
+    float band = 0.02f * fabsf(step);
+    float dt = _plant.stepUs * 1e-6f;
+    unsigned long steps = (unsigned long)((unsigned long long)_test.durationMs * 1000 / _plant.stepUs);
+    
+    float iae = 0.0f;
+    float peak = 0.0f;
+    unsigned long lastOutside = steps;
+    bool stable = true;
+    for (unsigned long i = 0; i < steps; i++) {
+        sim.step(_plant.stepUs);
+        float pv = sim.read();
+        pid.update(pv);
+        
+        float error = _test.setpoint - pv;
+        if (!std::isfinite(error)) {
+            stable = false;
+            break;
+        }
+        iae += fabsf(error) * dt;
+        peak = std::max(peak, -error * direction);
+        if (fabsf(sim.getValue() - _test.setpoint) > band) lastOutside = i;
+    }
+    sim.detach();
+    _evaluations++;
+    
+    Result result;
+    result.kp = kp;
+    result.ki = ki;
+    result.kd = kd;
+    result.iae = stable ? iae : std::numeric_limits<float>::infinity();
+    result.overshoot = step != 0.0f ? 100.0f * peak / fabsf(step) : 0.0f;
+    result.settlingTime = stable && lastOutside + 1 < steps ? (lastOutside + 1) * dt : -1.0f;
+    
+    float settling = result.settlingTime >= 0.0f ? result.settlingTime : _test.durationMs * 1e-3f;
+    result.cost = result.iae + _overshootWeight * result.overshoot + _settlingWeight * settling;
+    return result;
+}
+
+std::vector<PID_Search::Result> PID_Search::grid(unsigned steps) {
+    if (steps < 2) steps = 2;
+    std::vector<Result> results(steps * steps * steps);
+    parallelFor(results.size(), [&](size_t index) {
+        float u[3] = { (float)(index % steps) / (steps - 1),
+                       (float)(index / steps % steps) / (steps - 1),
+                       (float)(index / steps / steps) / (steps - 1) };
+        results[index] = evaluateUnit(u);
+    });
+    std::sort(results.begin(), results.end(), byCost);
+    return results;
+}
+
+std::vector<PID_Search::Result> PID_Search::refine(const std::vector<Result>& starts, unsigned iterations) {
+    std::vector<Result> results(starts.size());
+    parallelFor(starts.size(), [&](size_t index) {
+        // Simplex in the unit cube: the start and a step of 0.1 along each axis
+        const Result& start = starts[index];
+        float gains[3] = { start.kp, start.ki, start.kd };
+        float simplex[4][3];
+        Result scores[4];
+        for (int a = 0; a < 3; a++) {
+            float u = toUnit(_ranges[a], gains[a]);
+            for (int v = 0; v < 4; v++) simplex[v][a] = u;
+        }
+        for (int a = 0; a < 3; a++) {
+            simplex[a + 1][a] += simplex[a + 1][a] < 0.9f ? 0.1f : -0.1f;
+        }
+        scores[0] = start;
+        for (int v = 1; v < 4; v++) scores[v] = evaluateUnit(simplex[v]);
+        
+        for (unsigned iteration = 0; iteration < iterations; iteration++) {
+            // Order the vertices best first
+            int order[4] = { 0, 1, 2, 3 };
+            std::sort(order, order + 4, [&](int a, int b) { return scores[a].cost < scores[b].cost; });
+            float sorted[4][3];
+            Result sortedScores[4];
+            for (int v = 0; v < 4; v++) {
+                std::copy(simplex[order[v]], simplex[order[v]] + 3, sorted[v]);
+                sortedScores[v] = scores[order[v]];
+            }
+            std::copy(&sorted[0][0], &sorted[0][0] + 12, &simplex[0][0]);
+            std::copy(sortedScores, sortedScores + 4, scores);
+            
+            float centroid[3];
+            for (int a = 0; a < 3; a++) {
+                centroid[a] = (simplex[0][a] + simplex[1][a] + simplex[2][a]) / 3.0f;
+            }
+            auto along = [&](float t, float* out) {
+                for (int a = 0; a < 3; a++) {
+                    out[a] = std::min(std::max(centroid[a] + t * (simplex[3][a] - centroid[a]), 0.0f), 1.0f);
+                }
+            };
+            
+            float reflected[3];
+            along(-1.0f, reflected);
+            Result reflectedScore = evaluateUnit(reflected);
+            if (reflectedScore.cost < scores[0].cost) {
+                float expanded[3];
+                along(-2.0f, expanded);
+                Result expandedScore = evaluateUnit(expanded);
+                bool expand = expandedScore.cost < reflectedScore.cost;
+                std::copy(expand ? expanded : reflected, (expand ? expanded : reflected) + 3, simplex[3]);
+                scores[3] = expand ? expandedScore : reflectedScore;
+            } else if (reflectedScore.cost < scores[2].cost) {
+                std::copy(reflected, reflected + 3, simplex[3]);
+                scores[3] = reflectedScore;
+            } else {
+                float contracted[3];
+                along(reflectedScore.cost < scores[3].cost ? -0.5f : 0.5f, contracted);
+                Result contractedScore = evaluateUnit(contracted);
+                if (contractedScore.cost < std::min(reflectedScore.cost, scores[3].cost)) {
+                    std::copy(contracted, contracted + 3, simplex[3]);
+                    scores[3] = contractedScore;
+                } else {
+                    // Shrink towards the best vertex
+                    for (int v = 1; v < 4; v++) {
+                        for (int a = 0; a < 3; a++) {
+                            simplex[v][a] = simplex[0][a] + 0.5f * (simplex[v][a] - simplex[0][a]);
+                        }
+                        scores[v] = evaluateUnit(simplex[v]);
+                    }
+                }
+            }
+        }
+        results[index] = *std::min_element(scores, scores + 4, byCost);
+    });
+    std::sort(results.begin(), results.end(), byCost);
+    return results;
+}
+
+PID_Search::Result PID_Search::search(unsigned gridSteps, unsigned starts, unsigned iterations) {
+    std::vector<Result> candidates = grid(gridSteps);
+    if (starts == 0 || iterations == 0) return candidates.front();
+    if (candidates.size() > starts) candidates.resize(starts);
+    return refine(candidates, iterations).front();
+}
+
+unsigned long PID_Search::getEvaluations() {
+    return _evaluations;
+}
+
+std::string PID_Search::toCommand(const Result& result) {
+    char line[128];
+    snprintf(line, sizeof(line), "{\"cmd\": \"set_params\", \"kp\": %.6g, \"ki\": %.6g, \"kd\": %.6g}",
+             result.kp, result.ki, result.kd);
+    return line;
+}
+
+float PID_Search::toUnit(const Range& range, float gain) {
+    float u = 0.0f;
+    if (range.min > 0.0f && range.max > range.min) {
+        u = logf(gain / range.min) / logf(range.max / range.min);
+    } else if (range.max > range.min) {
+        u = (gain - range.min) / (range.max - range.min);
+    }
+    return std::min(std::max(u, 0.0f), 1.0f);
+}
+
+float PID_Search::toGain(const Range& range, float u) {
+    u = std::min(std::max(u, 0.0f), 1.0f);
+    if (range.min > 0.0f && range.max > range.min) {
+        return range.min * powf(range.max / range.min, u);
+    }
+    return range.min + (range.max - range.min) * u;
+}
+
+PID_Search::Result PID_Search::evaluateUnit(const float u[3]) {
+    return evaluate(toGain(_ranges[0], u[0]), toGain(_ranges[1], u[1]), toGain(_ranges[2], u[2]));
+}
+
+// Workers take the next index until none are left
+void PID_Search::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    // The first simulator installs the PID_Hal hooks before any worker starts
+    threadSim().begin();
+    
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t index = next++; index < count; index = next++) body(index);
+    };
+    unsigned threads = std::min<size_t>(getThreads(), count);
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++) pool.emplace_back(worker);
+    worker();
+    for (std::thread& thread : pool) thread.join();
+}
@@ -0,0 +1,102 @@
+/**************************************************************************************************
+ * PID_Search - Offline gain search against PID_Sim plants (host build)
+ * 
+ * Scores Kp/Ki/Kd sets with a simulated step test, a PID_Control closing the loop around a
+ * PID_Sim model, and searches the gain space for the lowest cost: a grid over the ranges first,
+ * then Nelder-Mead from the best grid points. Evaluations are spread over a pool of threads,
+ * each with its own simulator and controller. PID_Hal is left on the simulators' clock.
+ * 
+ * Cost = IAE + overshootWeight * overshoot (% of the step) + settlingWeight * settling time (s)
+ **************************************************************************************************/
+
+#pragma once
+
+#include <PID_Sim.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+class PID_Search {
+    public:
+        struct Plant {
+            PID_Sim::Model model = PID_Sim::MODEL_FIRST_ORDER;
+            float gain = 1.0f;
+            float timeConstant = 10.0f;     // s, first order
+            float naturalFrequency = 1.0f;  // rad/s, second order
+            float damping = 0.7f;           // Second order
+            float deadTime = 0.0f;          // s
+            float offset = 0.0f;            // pv at zero output, where the test starts
+            float noise = 0.0f;
+            uint32_t seed = 1;
+            unsigned long stepUs = PID_SIM_STEP;
+        };
+        
+        // Step test from the plant's offset to setpoint
+        struct Test {
+            float setpoint = 1.0f;
+            unsigned long durationMs = 60000;
+            unsigned long sampleTimeMs = 100;
+            float outputMin = 0.0f;
+            float outputMax = 255.0f;
+        };
+        
+        // Searched gain range; spaced logarithmically when min > 0
+        struct Range {
+            float min;
+            float max;
+        };
+        
+        struct Result {
+            float kp;
+            float ki;
+            float kd;
+            float cost;
+            float iae;
+            float overshoot;     // % of the step
+            float settlingTime;  // s until pv stays within 2% of the step, -1 if it doesn't
+        };
+        
+        PID_Search();
+        
+        void setPlant(const Plant& plant);
+        void setTest(const Test& test);
+        void setRanges(Range kp, Range ki, Range kd);
+        void setWeights(float overshoot, float settling);
+        
+        // Worker threads, 0 for one per core
+        void setThreads(unsigned threads);
+        unsigned getThreads();
+        
+        // One step test; safe to call from several threads
+        Result evaluate(float kp, float ki, float kd);
+        
+        // steps points per axis, all evaluated; sorted by cost
+        std::vector<Result> grid(unsigned steps);
+        
+        // Nelder-Mead from each start, the starts in parallel; sorted by cost
+        std::vector<Result> refine(const std::vector<Result>& starts, unsigned iterations);
+        
+        // grid(), then refine() of the best starts points
+        Result search(unsigned gridSteps = 10, unsigned starts = 4, unsigned iterations = 60);
+        
+        unsigned long getEvaluations();
+        
+        // The gains as a PID_Tune command: {"cmd": "set_params", "kp": ..., "ki": ..., "kd": ...}
+        static std::string toCommand(const Result& result);
+    
+    private:
+        // Gains <-> unit cube coordinates the searches work in
+        float toUnit(const Range& range, float gain);
+        float toGain(const Range& range, float u);
+        Result evaluateUnit(const float u[3]);
+        void parallelFor(size_t count, const std::function<void(size_t)>& body);
+        
+        Plant _plant;
+        Test _test;
+        Range _ranges[3];
+        float _overshootWeight;
+        float _settlingWeight;
+        unsigned _threads;
+        std::atomic<unsigned long> _evaluations;
+};
@@ -0,0 +1,177 @@
+/**************************************************************************************************
+ * pid_search - Offline gain search for a simulated plant
+ * 
+ *     pid_search --gain 2 --tau 30 --dead 5 --offset 20 --setpoint 60 --duration 300000
+ * 
+ * Prints the best candidates, then the recommended gains as a set_params command on the last
+ * line, ready to send to PID_Tune. --help lists the options.
+ **************************************************************************************************/
+
+#include "PID_Search.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void usage() {
+    printf("Usage: pid_search [options]\n"
+           "Plant:\n"
+           "  --model fopdt|sopdt  First order (default) or second order plus dead time\n"
+           "  --gain K             Process gain, pv per unit of output (1)\n"
+           "  --tau s              First order time constant (10)\n"
+           "  --wn rad/s           Second order natural frequency (1)\n"
+           "  --zeta z             Second order damping (0.7)\n"
+           "  --dead s             Dead time (0)\n"
+           "  --offset pv          pv at zero output, where the step starts (0)\n"
+           "  --noise a            Uniform sensor noise of +-a (0)\n"
+           "  --step us            Model step (%d)\n"
+           "Test:\n"
+           "  --setpoint sp        Step target (1)\n"
+           "  --duration ms        Test length (60000)\n"
+           "  --sample ms          Controller sample time (100)\n"
+           "  --out-min v          Output limits (0)\n"
+           "  --out-max v          (255)\n"
+           "Search:\n"
+           "  --kp min:max         Gain ranges, log-spaced when min > 0 (0.01:10)\n"
+           "  --ki min:max         (0:1)\n"
+           "  --kd min:max         (0:10)\n"
+           "  --grid n             Grid points per gain (10)\n"
+           "  --starts n           Nelder-Mead runs from the best grid points (4)\n"
+           "  --iterations n       Nelder-Mead iterations per run (60)\n"
+           "  --overshoot w        Cost per %% of overshoot (0)\n"
+           "  --settling w         Cost per second of settling time (0)\n"
+           "  --threads n          Worker threads, 0 for one per core (0)\n",
+           PID_SIM_STEP);
+}
+
+static bool parseRange(const char* text, PID_Search::Range& range) {
+    char* end;
+    range.min = strtof(text, &end);
+    if (*end != ':') return false;
+    range.max = strtof(end + 1, &end);
+    return *end == '\0' && range.max >= range.min;
+}
+
+static void printResult(const PID_Search::Result& result) {
+    printf("kp=%-10.5g ki=%-10.5g kd=%-10.5g cost=%-10.5g iae=%-10.5g overshoot=%5.1f%%  settling=",
+           result.kp, result.ki, result.kd, result.cost, result.iae, result.overshoot);
+    if (result.settlingTime >= 0.0f) {
+        printf("%.2fs\n", result.settlingTime);
+    } else {
+        printf("-\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    PID_Search::Plant plant;
+    PID_Search::Test test;
+    PID_Search::Range ranges[3] = { { 0.01f, 10.0f }, { 0.0f, 1.0f }, { 0.0f, 10.0f } };
+    unsigned gridSteps = 10;
+    unsigned starts = 4;
+    unsigned iterations = 60;
+    float overshootWeight = 0.0f;
+    float settlingWeight = 0.0f;
+    unsigned threads = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        if (!strcmp(option, "--help") || !strcmp(option, "-h")) {
+            usage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "%s needs a value\n", option);
+            return 1;
+        }
+        const char* value = argv[++i];
+        
+        bool ok = true;
+        if (!strcmp(option, "--model")) {
+            if (!strcmp(value, "fopdt")) {
+                plant.model = PID_Sim::MODEL_FIRST_ORDER;
+            } else if (!strcmp(value, "sopdt")) {
+                plant.model = PID_Sim::MODEL_SECOND_ORDER;
+            } else {
+                ok = false;
+            }
+        } else if (!strcmp(option, "--gain")) {
+            plant.gain = strtof(value, nullptr);
+        } else if (!strcmp(option, "--tau")) {
+            plant.timeConstant = strtof(value, nullptr);
+        } else if (!strcmp(option, "--wn")) {
+            plant.naturalFrequency = strtof(value, nullptr);
+        } else if (!strcmp(option, "--zeta")) {
+            plant.damping = strtof(value, nullptr);
+        } else if (!strcmp(option, "--dead")) {
+            plant.deadTime = strtof(value, nullptr);
+        } else if (!strcmp(option, "--offset")) {
+            plant.offset = strtof(value, nullptr);
+        } else if (!strcmp(option, "--noise")) {
+            plant.noise = strtof(value, nullptr);
+        } else if (!strcmp(option, "--step")) {
+            plant.stepUs = strtoul(value, nullptr, 10);
+        } else if (!strcmp(option, "--setpoint")) {
+            test.setpoint = strtof(value, nullptr);
+        } else if (!strcmp(option, "--duration")) {
+            test.durationMs = strtoul(value, nullptr, 10);
+        } else if (!strcmp(option, "--sample")) {
+            test.sampleTimeMs = strtoul(value, nullptr, 10);
+        } else if (!strcmp(option, "--out-min")) {
+            test.outputMin = strtof(value, nullptr);
+        } else if (!strcmp(option, "--out-max")) {
+            test.outputMax = strtof(value, nullptr);
+        } else if (!strcmp(option, "--kp")) {
+            ok = parseRange(value, ranges[0]);
+        } else if (!strcmp(option, "--ki")) {
+            ok = parseRange(value, ranges[1]);
+        } else if (!strcmp(option, "--kd")) {
+            ok = parseRange(value, ranges[2]);
+        } else if (!strcmp(option, "--grid")) {
+            gridSteps = strtoul(value, nullptr, 10);
+        } else if (!strcmp(option, "--starts")) {
+            starts = strtoul(value, nullptr, 10);
+        } else if (!strcmp(option, "--iterations")) {
+            iterations = strtoul(value, nullptr, 10);
+        } else if (!strcmp(option, "--overshoot")) {
+            overshootWeight = strtof(value, nullptr);
+        } else if (!strcmp(option, "--settling")) {
+            settlingWeight = strtof(value, nullptr);
+        } else if (!strcmp(option, "--threads")) {
+            threads = strtoul(value, nullptr, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s (see --help)\n", option);
+            return 1;
+        }
+        if (!ok) {
+            fprintf(stderr, "Invalid value for %s: %s\n", option, value);
+            return 1;
+        }
+    }
+    
+    PID_Search search;
+    search.setPlant(plant);
+    search.setTest(test);
+    search.setRanges(ranges[0], ranges[1], ranges[2]);
+    search.setWeights(overshootWeight, settlingWeight);
+    search.setThreads(threads);
+    
+    auto start = std::chrono::steady_clock::now();
+    std::vector<PID_Search::Result> candidates = search.grid(gridSteps);
+    printf("Grid, %u points per gain:\n", gridSteps < 2 ? 2 : gridSteps);
+    for (size_t i = 0; i < candidates.size() && i < 5; i++) printResult(candidates[i]);
+    
+    PID_Search::Result best = candidates.front();
+    if (starts > 0 && iterations > 0) {
+        if (candidates.size() > starts) candidates.resize(starts);
+        std::vector<PID_Search::Result> refined = search.refine(candidates, iterations);
+        printf("Nelder-Mead from the best %zu:\n", candidates.size());
+        for (const PID_Search::Result& result : refined) printResult(result);
+        best = refined.front();
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%lu step tests in %.2fs on %u threads (%.0f/s)\n", search.getEvaluations(), seconds,
+           search.getThreads(), search.getEvaluations() / seconds);
+    printf("%s\n", PID_Search::toCommand(best).c_str());
+    return 0;
+}
@@ -0,0 +1,28 @@
+/**************************************************************************************************
+ * Minimal Arduino core for building the library on a desktop (extras/host)
+ * Implementation
+ **************************************************************************************************/
+
+#include "Arduino.h"
+#include <chrono>
+#include <thread>
+
+static const std::chrono::steady_clock::time_point s_start = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+    auto elapsed = std::chrono::steady_clock::now() - s_start;
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+unsigned long micros() {
+    auto elapsed = std::chrono::steady_clock::now() - s_start;
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void pinMode(int, int) {}
+
+void analogWrite(int, int) {}
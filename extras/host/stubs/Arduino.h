@@ -0,0 +1,88 @@
+/**************************************************************************************************
+ * Minimal Arduino core for building the library on a desktop (extras/host)
+ * 
+ * Only what the library uses: Print/Stream, the clock and output functions and a few macros.
+ * The clock runs on std::chrono::steady_clock; outputs are discarded unless a PID_Hal output
+ * hook is installed.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using std::abs;
+using std::isnan;
+
+typedef uint8_t byte;
+
+#define INPUT 0
+#define OUTPUT 1
+#define DEC 10
+#define HEX 16
+#define PI 3.1415926535897932384626433832795
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void pinMode(int pin, int mode);
+void analogWrite(int pin, int value);
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t* buffer, size_t size) {
+            size_t n = 0;
+            while (size--) n += write(*buffer++);
+            return n;
+        }
+        size_t write(const char* str) {
+            return write((const uint8_t*)str, strlen(str));
+        }
+        virtual int availableForWrite() {
+            return 0;
+        }
+        virtual void flush() {}
+        
+        size_t print(const char* str) { return write(str); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(int value, int base = DEC) { return print((long)value, base); }
+        size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+        size_t print(long value, int base = DEC) { return printf(base == HEX ? "%lX" : "%ld", value); }
+        size_t print(unsigned long value, int base = DEC) { return printf(base == HEX ? "%lX" : "%lu", value); }
+        size_t print(double value, int digits = 2) { return printf("%.*f", digits, value); }
+        
+        template <typename T>
+        size_t println(T value) { return print(value) + println(); }
+        template <typename T>
+        size_t println(T value, int format) { return print(value, format) + println(); }
+        size_t println() { return write("\r\n"); }
+        
+    private:
+        template <typename T>
+        size_t printf(const char* format, T value) {
+            char text[32];
+            snprintf(text, sizeof(text), format, value);
+            return write(text);
+        }
+        size_t printf(const char* format, int digits, double value) {
+            char text[48];
+            snprintf(text, sizeof(text), format, digits, value);
+            return write(text);
+        }
+};
+
+class Stream : public Print {
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+};
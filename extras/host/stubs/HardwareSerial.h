@@ -0,0 +1,20 @@
+/**************************************************************************************************
+ * HardwareSerial stand-in for the desktop build: a Stream the host program feeds and drains
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+class HardwareSerial : public Stream {
+    public:
+        virtual void begin(unsigned long) {}
+        operator bool() const { return true; }
+        
+        // Nothing is connected by default
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+        size_t write(uint8_t) override { return 1; }
+        int availableForWrite() override { return 64; }
+};
@@ -0,0 +1,23 @@
+/**************************************************************************************************
+ * IPAddress stand-in for the desktop build (IPv4 only)
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+class IPAddress {
+    public:
+        IPAddress() : _address(0) {}
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+            : _address((uint32_t)a | (uint32_t)b << 8 | (uint32_t)c << 16 | (uint32_t)d << 24) {}
+        explicit IPAddress(uint32_t address) : _address(address) {}
+        
+        operator uint32_t() const { return _address; }
+        uint8_t operator[](int index) const { return (uint8_t)(_address >> (8 * index)); }
+        bool operator==(const IPAddress& other) const { return _address == other._address; }
+        bool operator!=(const IPAddress& other) const { return _address != other._address; }
+        
+    private:
+        uint32_t _address;  // First octet in the low byte, as on the Arduino cores
+};
@@ -0,0 +1,26 @@
+/**************************************************************************************************
+ * UDP interface of the Arduino cores (WiFiUDP, EthernetUDP derive from it), for the desktop build
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+class UDP : public Stream {
+    public:
+        virtual uint8_t begin(uint16_t port) = 0;
+        virtual void stop() = 0;
+        
+        virtual int beginPacket(IPAddress ip, uint16_t port) = 0;
+        virtual int endPacket() = 0;
+        using Print::write;
+        virtual size_t write(const uint8_t* buffer, size_t size) override = 0;
+        
+        virtual int parsePacket() = 0;
+        virtual int read(unsigned char* buffer, size_t length) = 0;
+        using Stream::read;
+        
+        virtual IPAddress remoteIP() = 0;
+        virtual uint16_t remotePort() = 0;
+};
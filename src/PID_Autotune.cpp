@@ -0,0 +1,266 @@
+/**************************************************************************************************
+ * PID_Autotune - Relay-feedback (Astrom-Hagglund) autotuner for PID_Control
+ * Implementation
+ **************************************************************************************************/
+
+#include "PID_Autotune.h"
+
+PID_Autotune::PID_Autotune() {
+    _pid = nullptr;
+    _amplitude = 0.0;
+    _hysteresis = 0.0;
+    _rule = ZIEGLER_NICHOLS;
+    _cycles = 4;
+    _timeoutMs = PID_AUTOTUNE_TIMEOUT;
+    _state = IDLE;
+    reset();
+}
+
+PID_Autotune::PID_Autotune(PID_Control& pid) : PID_Autotune() {
+    _pid = &pid;
+}
+
+bool PID_Autotune::setController(PID_Control& pid) {
+    if (_state == RUNNING) return false;
+    _pid = &pid;
+    return true;
+}
+
+void PID_Autotune::reset() {
+    if (_state == RUNNING) return;
+    _state = IDLE;
+    _failure = FAILURE_NONE;
+    _Ku = 0.0;
+    _Tu = 0.0;
+    _Kp = 0.0;
+    _Ki = 0.0;
+    _Kd = 0.0;
+}
+
+void PID_Autotune::setRelay(float amplitude, float hysteresis) {
+    _amplitude = amplitude > 0.0 ? amplitude : 0.0;
+    _hysteresis = hysteresis > 0.0 ? hysteresis : 0.0;
+}
+
+void PID_Autotune::setRule(Rule rule) {
+    _rule = rule;
+}
+
+PID_Autotune::Rule PID_Autotune::getRule() {
+    return _rule;
+}
+
+void PID_Autotune::setCycles(uint8_t cycles) {
+    if (cycles < 2) cycles = 2;
+    if (cycles > PID_AUTOTUNE_MAX_CYCLES) cycles = PID_AUTOTUNE_MAX_CYCLES;
+    _cycles = cycles;
+}
+
+void PID_Autotune::setTimeout(unsigned long timeoutMs) {
+    _timeoutMs = timeoutMs;
+}
+
+bool PID_Autotune::start() {
+    if (_state == RUNNING) return false;
+    reset();
+    
+    if (!_pid || !_pid->isEnabled()) {
+        fail(FAILURE_DISABLED);
+        return false;
+    }
+    
+    // Relay levels around the current output, within the output limits. Which level raises the
+    // process value depends on the controller polarity.
+    _bias = _pid->getOutput();
+    float up = _bias + _amplitude;
+    float down = _bias - _amplitude;
+    if (up > _pid->_output_max) up = _pid->_output_max;
+    if (down < _pid->_output_min) down = _pid->_output_min;
+    _high = _pid->_polarity ? up : down;
+    _low = _pid->_polarity ? down : up;
+    if (up - down <= 0.0) {
+        fail(FAILURE_AMPLITUDE);
+        return false;
+    }
+    
+    _startTime = _pid->getLastUpdateTime();
+    _lastSample = _startTime;
+    _haveRise = false;
+    _settle = 1;  // The first period still carries the start transient
+    _count = 0;
+    _next = 0;
+    
+    _pid->setManual(true);
+    setRelayOutput(_pid->getInput() < _pid->getSetpoint());
+    _state = RUNNING;
+    return true;
+}
+
+void PID_Autotune::stop() {
+    if (_state == RUNNING) fail(FAILURE_STOPPED);
+}
+
+bool PID_Autotune::update() {
+    if (_state != RUNNING) return false;
+    
+    if (!_pid->isEnabled()) {
+        fail(FAILURE_DISABLED);
+        return false;
+    }
+    
+    unsigned long now = _pid->getLastUpdateTime();
+    if (now == _lastSample) return true;
+    _lastSample = now;
+    
+    if ((now - _startTime) * _pid->_secondsPerTick * 1000.0 > _timeoutMs) {
+        fail(FAILURE_TIMEOUT);
+        return false;
+    }
+    
+    float pv = _pid->getInput();
+    float sp = _pid->getSetpoint();
+    if (pv > _pvMax) _pvMax = pv;
+    if (pv < _pvMin) _pvMin = pv;
+    
+    if (!_raising && pv < sp - _hysteresis) {
+        setRelayOutput(true);
+        
+        // One full relay period ends at each switch to the raising level
+        if (_haveRise) {
+            if (_settle > 0) {
+                _settle--;
+            } else {
+                _periods[_next] = now - _lastRise;
+                _amplitudes[_next] = (_pvMax - _pvMin) / 2.0;
+                _next = (_next + 1) % _cycles;
+                if (_count < _cycles) _count++;
+                
+                if (_count == _cycles) {
+                    finish();
+                    if (_state != RUNNING) return false;
+                }
+            }
+        }
+        _haveRise = true;
+        _lastRise = now;
+        _pvMax = pv;
+        _pvMin = pv;
+    } else if (_raising && pv > sp + _hysteresis) {
+        setRelayOutput(false);
+    }
+    return true;
+}
+
+PID_Autotune::State PID_Autotune::getState() {
+    return _state;
+}
+
+bool PID_Autotune::isRunning() {
+    return _state == RUNNING;
+}
+
+PID_Autotune::Failure PID_Autotune::getFailure() {
+    return _failure;
+}
+
+float PID_Autotune::getUltimateGain() {
+    return _Ku;
+}
+
+float PID_Autotune::getUltimatePeriod() {
+    return _Tu;
+}
+
+float PID_Autotune::getKp() {
+    return _Kp;
+}
+
+float PID_Autotune::getKi() {
+    return _Ki;
+}
+
+float PID_Autotune::getKd() {
+    return _Kd;
+}
+
+bool PID_Autotune::applyGains() {
+    if (_state != DONE || !_pid) return false;
+    _pid->setPID(_Kp, _Ki, _Kd);
+    return true;
+}
+
+// Compute the result once the last _cycles periods agree, otherwise keep oscillating
+void PID_Autotune::finish() {
+    float periodMean = 0.0;
+    float amplitudeMean = 0.0;
+    unsigned long periodMin = _periods[0];
+    unsigned long periodMax = _periods[0];
+    for (uint8_t i = 0; i < _cycles; i++) {
+        periodMean += _periods[i];
+        amplitudeMean += _amplitudes[i];
+        if (_periods[i] < periodMin) periodMin = _periods[i];
+        if (_periods[i] > periodMax) periodMax = _periods[i];
+    }
+    periodMean /= _cycles;
+    amplitudeMean /= _cycles;
+    
+    // Within 20% of each other: a steady limit cycle
+    if ((periodMax - periodMin) > 0.2 * periodMean) return;
+    
+    if (amplitudeMean <= _hysteresis) {
+        fail(FAILURE_AMPLITUDE);
+        return;
+    }
+    
+    float d = (_high > _low ? _high - _low : _low - _high) / 2.0;
+    float a = sqrt(amplitudeMean * amplitudeMean - _hysteresis * _hysteresis);
+    float Ku = 4.0 * d / (PI * a);
+    float Tu = periodMean * _pid->_secondsPerTick;
+    
+    float Kp, Ti, Td;
+    switch (_rule) {
+        case ZIEGLER_NICHOLS_PI:
+            Kp = 0.45 * Ku;
+            Ti = Tu / 1.2;
+            Td = 0.0;
+            break;
+        case TYREUS_LUYBEN:
+            Kp = Ku / 2.2;
+            Ti = 2.2 * Tu;
+            Td = Tu / 6.3;
+            break;
+        case TYREUS_LUYBEN_PI:
+            Kp = Ku / 3.2;
+            Ti = 2.2 * Tu;
+            Td = 0.0;
+            break;
+        case ZIEGLER_NICHOLS:
+        default:
+            Kp = 0.6 * Ku;
+            Ti = Tu / 2.0;
+            Td = Tu / 8.0;
+            break;
+    }
+    
+    _Ku = Ku;
+    _Tu = Tu;
+    _Kp = Kp;
+    _Ki = Kp / Ti;
+    _Kd = Kp * Td;
+    
+    _pid->setManual(false);
+    PID_SPSC_BARRIER();  // Results before the state, another core may be polling it
+    _state = DONE;
+}
+
+void PID_Autotune::fail(Failure failure) {
+    if (_pid) _pid->setManual(false);
+    _failure = failure;
+    PID_SPSC_BARRIER();
+    _state = FAILED;
+}
+
+void PID_Autotune::setRelayOutput(bool raise) {
+    _raising = raise;
+    _pid->setManualOutput(raise ? _high : _low);
+}
@@ -0,0 +1,132 @@
+/**************************************************************************************************
+ * PID_Autotune - Relay-feedback (Astrom-Hagglund) autotuner for PID_Control
+ * 
+ * Puts the controller in manual mode and switches its output between two levels around the
+ * starting output whenever the process value crosses the setpoint (with hysteresis). The loop
+ * settles into a limit cycle whose period and amplitude give the ultimate period Tu and gain
+ * Ku = 4d / (pi * sqrt(a^2 - eps^2)), from which PID gains follow by the selected rule.
+ * 
+ * Everything runs at the controller's sample rate on the device. Call update() after the
+ * controller's update() (PID_Tune does this for you with the "autotune" command).
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <PID_Control.h>
+#include <PID_Spsc.h>
+
+// Most relay periods averaged for the result
+#ifndef PID_AUTOTUNE_MAX_CYCLES
+#define PID_AUTOTUNE_MAX_CYCLES 8
+#endif
+
+// Default give-up time in milliseconds
+#ifndef PID_AUTOTUNE_TIMEOUT
+#define PID_AUTOTUNE_TIMEOUT 600000UL
+#endif
+
+class PID_Autotune {
+    public:
+        enum Rule : uint8_t {
+            ZIEGLER_NICHOLS,     // Kp = 0.6 Ku, Ti = Tu/2, Td = Tu/8 (fast, ~quarter decay)
+            ZIEGLER_NICHOLS_PI,  // Kp = 0.45 Ku, Ti = Tu/1.2
+            TYREUS_LUYBEN,       // Kp = Ku/2.2, Ti = 2.2 Tu, Td = Tu/6.3 (less overshoot)
+            TYREUS_LUYBEN_PI     // Kp = Ku/3.2, Ti = 2.2 Tu
+        };
+        
+        enum State : uint8_t {
+            IDLE,
+            RUNNING,
+            DONE,
+            FAILED
+        };
+        
+        enum Failure : uint8_t {
+            FAILURE_NONE,
+            FAILURE_TIMEOUT,       // No steady oscillation before the timeout
+            FAILURE_DISABLED,      // The controller was disabled (stop or safety error)
+            FAILURE_AMPLITUDE,     // Oscillation didn't clear the hysteresis band
+            FAILURE_STOPPED        // stop() was called
+        };
+        
+        PID_Autotune();
+        PID_Autotune(PID_Control& pid);
+        
+        // Controller to tune, not while a test is running
+        bool setController(PID_Control& pid);
+        
+        // Back to IDLE, discarding the last result
+        void reset();
+        
+        // Relay step d either side of the starting output, and the noise band around the setpoint
+        void setRelay(float amplitude, float hysteresis = 0.0);
+        void setRule(Rule rule);
+        Rule getRule();
+        void setCycles(uint8_t cycles);  // Periods averaged (default 4, after one settling period)
+        void setTimeout(unsigned long timeoutMs);
+        
+        // Start the relay around the controller's current output
+        bool start();
+        void stop();
+        
+        // Call after the controller's update(); only new samples are processed.
+        // Returns true while the test is running.
+        bool update();
+        
+        State getState();
+        bool isRunning();
+        Failure getFailure();
+        
+        // Results, valid in the DONE state
+        float getUltimateGain();
+        float getUltimatePeriod();  // Seconds
+        float getKp();
+        float getKi();
+        float getKd();
+        
+        // Load the computed gains into the controller
+        bool applyGains();
+        
+    private:
+        void finish();
+        void fail(Failure failure);
+        void setRelayOutput(bool raise);
+        
+        PID_Control* _pid;
+        
+        // Settings
+        float _amplitude;
+        float _hysteresis;
+        Rule _rule;
+        uint8_t _cycles;
+        unsigned long _timeoutMs;
+        
+        // Relay state
+        volatile State _state;
+        Failure _failure;
+        float _bias;
+        float _high;
+        float _low;
+        bool _raising;
+        unsigned long _startTime;
+        unsigned long _lastSample;
+        unsigned long _lastRise;
+        bool _haveRise;
+        float _pvMax;
+        float _pvMin;
+        uint8_t _settle;  // Periods still to discard
+        
+        // Measured periods (time base ticks) and half peak-to-peak amplitudes, ring of _cycles
+        unsigned long _periods[PID_AUTOTUNE_MAX_CYCLES];
+        float _amplitudes[PID_AUTOTUNE_MAX_CYCLES];
+        uint8_t _count;
+        uint8_t _next;
+        
+        // Results
+        float _Ku;
+        float _Tu;
+        float _Kp;
+        float _Ki;
+        float _Kd;
+};
@@ -0,0 +1,232 @@
+/**************************************************************************************************
+ * PID_Bank - Multi-channel PID kernel
+ * 
+ * Runs the PID_Control algorithm (P, clamped integral, derivative on measurement, output clamp)
+ * for N channels at once. State is kept as structure-of-arrays so the update is one branch-free
+ * loop over contiguous floats that the compiler can vectorize (build with -O3 for best results).
+ * 
+ * All channels share one sample time and algorithm form (positional, or velocity with
+ * setVelocityForm()). The bank has no safety features, enable flags or pin
+ * output; read the results with getOutput() / getOutputs() and drive the actuators yourself.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <PID_Hal.h>
+#include <PID_Velocity.h>
+
+template <size_t N>
+class PID_Bank {
+    public:
+        PID_Bank() {
+            for (size_t i = 0; i < N; i++) {
+                _Kp[i] = 0.0f;
+                _Ki[i] = 0.0f;
+                _Kd[i] = 0.0f;
+                _KiTs[i] = 0.0f;
+                _KdTs[i] = 0.0f;
+                _setpoint[i] = 0.0f;
+                _sign[i] = 1.0f;
+                _integral[i] = 0.0f;
+                _prev_input[i] = 0.0f;
+                _prev_input2[i] = 0.0f;
+                _prev_error[i] = 0.0f;
+                _output[i] = 0.0f;
+                _output_min[i] = 0.0f;
+                _output_max[i] = 255.0f;
+                _integral_min[i] = -1000.0f;
+                _integral_max[i] = 1000.0f;
+                _primed[i] = false;
+            }
+            _sample_time = 100;
+            _last_time = 0;
+            _velocityForm = false;
+            _velocityPrimed = false;
+        }
+        
+        // Per-channel configuration, same meaning as the PID_Control methods. begin() only
+        // resets its own channel, the others keep running.
+        void begin(size_t ch, float Kp, float Ki, float Kd, float setpoint, bool polarity = true) {
+            if (ch >= N) return;
+            setPID(ch, Kp, Ki, Kd);
+            _setpoint[ch] = setpoint;
+            _sign[ch] = polarity ? 1.0f : -1.0f;
+            _prev_input[ch] = 0.0f;
+            _prev_input2[ch] = 0.0f;
+            _prev_error[ch] = 0.0f;
+            _output[ch] = 0.0f;
+            _primed[ch] = false;
+            _velocityPrimed = false;
+        }
+        
+        // Start the shared sample timing: the first update() computes one sample time from now
+        void start() {
+            _last_time = PID_Hal::millis();
+        }
+        
+        void setPID(size_t ch, float Kp, float Ki, float Kd) {
+            if (ch >= N) return;
+            _Kp[ch] = Kp;
+            _Ki[ch] = Ki;
+            _Kd[ch] = Kd;
+            _integral[ch] = 0.0f;
+            updateScaledGains(ch);
+        }
+        
+        void setpoint(size_t ch, float setpoint) {
+            if (ch < N) _setpoint[ch] = setpoint;
+        }
+        
+        void setOutputLimits(size_t ch, float min, float max) {
+            if (ch >= N || min >= max) return;
+            _output_min[ch] = min;
+            _output_max[ch] = max;
+        }
+        
+        void setIntegralLimits(size_t ch, float min, float max) {
+            if (ch >= N || min >= max) return;
+            _integral_min[ch] = min;
+            _integral_max[ch] = max;
+            _integral[ch] = clamp(_integral[ch], min, max);
+        }
+        
+        // Shared sample time in milliseconds
+        void setSampleTime(unsigned long sample_time) {
+            if (sample_time == 0) return;
+            _sample_time = sample_time;
+            for (size_t i = 0; i < N; i++) updateScaledGains(i);
+        }
+        
+        // Velocity (incremental) form for every channel, see PID_Control::setVelocityForm().
+        // Switching back to positional form seeds the integrals so the outputs carry on.
+        void setVelocityForm(bool enabled) {
+            if (enabled == _velocityForm) return;
+            _velocityForm = enabled;
+            unprime();
+            if (!enabled) {
+                for (size_t i = 0; i < N; i++) {
+                    float integral = _sign[i] * _output[i] - _Kp[i] * (_setpoint[i] - _prev_input[i]);
+                    _integral[i] = clamp(integral, _integral_min[i], _integral_max[i]);
+                }
+            }
+        }
+        bool isVelocityForm() { return _velocityForm; }
+        
+        // Run compute() when the sample time has elapsed; returns true if it did
+        bool update(const float* inputs) {
+            unsigned long now = PID_Hal::millis();
+            if (now - _last_time < _sample_time) return false;
+            _last_time = now;
+            compute(inputs);
+            return true;
+        }
+        
+        // One fixed-step update of every channel, inputs[] holds N process values
+        void compute(const float* inputs) {
+            if (_velocityForm) {
+                computeVelocity(inputs);
+                return;
+            }
+            for (size_t i = 0; i < N; i++) {
+                float input = inputs[i];
+                float error = _setpoint[i] - input;
+                
+                float integral = clamp(_integral[i] + _KiTs[i] * error, _integral_min[i], _integral_max[i]);
+                float derivative = _KdTs[i] * (input - _prev_input[i]);
+                float output = _sign[i] * (_Kp[i] * error + integral - derivative);
+                
+                _integral[i] = integral;
+                _prev_input[i] = input;
+                _output[i] = clamp(output, _output_min[i], _output_max[i]);
+            }
+        }
+        
+        void reset() {
+            for (size_t i = 0; i < N; i++) {
+                _integral[i] = 0.0f;
+                _prev_input[i] = 0.0f;
+                _output[i] = 0.0f;
+            }
+            unprime();
+            start();
+        }
+        
+        float getOutput(size_t ch) { return ch < N ? _output[ch] : 0.0f; }
+        const float* getOutputs() { return _output; }
+        float getIntegral(size_t ch) { return ch < N ? _sign[ch] * _integral[ch] : 0.0f; }
+        float getSetpoint(size_t ch) { return ch < N ? _setpoint[ch] : 0.0f; }
+        float getKp(size_t ch) { return ch < N ? _Kp[ch] : 0.0f; }
+        float getKi(size_t ch) { return ch < N ? _Ki[ch] : 0.0f; }
+        float getKd(size_t ch) { return ch < N ? _Kd[ch] : 0.0f; }
+        unsigned long getSampleTime() { return _sample_time; }
+        size_t size() { return N; }
+        
+    private:
+        // Velocity-form update; a channel's first one after its begin(), reset() or a form change
+        // only primes its history so old inputs don't kick the output
+        void computeVelocity(const float* inputs) {
+            if (!_velocityPrimed) {
+                for (size_t i = 0; i < N; i++) {
+                    if (_primed[i]) continue;
+                    _prev_input[i] = _prev_input2[i] = inputs[i];
+                    _prev_error[i] = _setpoint[i] - inputs[i];
+                    _primed[i] = true;
+                }
+                _velocityPrimed = true;
+            }
+            for (size_t i = 0; i < N; i++) {
+                float input = inputs[i];
+                float error = _setpoint[i] - input;
+                
+                float delta = pidVelocityDelta(_Kp[i], _KiTs[i], _KdTs[i], error, _prev_error[i],
+                                               input, _prev_input[i], _prev_input2[i]);
+                
+                _prev_error[i] = error;
+                _prev_input2[i] = _prev_input[i];
+                _prev_input[i] = input;
+                _output[i] = clamp(_output[i] + _sign[i] * delta, _output_min[i], _output_max[i]);
+            }
+        }
+        
+        void unprime() {
+            for (size_t i = 0; i < N; i++) _primed[i] = false;
+            _velocityPrimed = false;
+        }
+        
+        // Select-style clamp so the loop body stays branch-free
+        static inline float clamp(float value, float min, float max) {
+            value = value < min ? min : value;
+            return value > max ? max : value;
+        }
+        
+        // Ki*Ts and Kd/Ts for the shared sample time, keeps divisions out of compute()
+        void updateScaledGains(size_t ch) {
+            float ts = _sample_time / 1000.0f;
+            _KiTs[ch] = _Ki[ch] * ts;
+            _KdTs[ch] = _Kd[ch] / ts;
+        }
+        
+        alignas(16) float _Kp[N];
+        alignas(16) float _Ki[N];
+        alignas(16) float _Kd[N];
+        alignas(16) float _KiTs[N];
+        alignas(16) float _KdTs[N];
+        alignas(16) float _setpoint[N];
+        alignas(16) float _sign[N];
+        alignas(16) float _integral[N];
+        alignas(16) float _prev_input[N];
+        alignas(16) float _prev_input2[N];
+        alignas(16) float _prev_error[N];
+        alignas(16) float _output[N];
+        alignas(16) float _output_min[N];
+        alignas(16) float _output_max[N];
+        alignas(16) float _integral_min[N];
+        alignas(16) float _integral_max[N];
+        
+        unsigned long _sample_time;
+        unsigned long _last_time;
+        bool _primed[N];       // Channel's velocity history primed
+        bool _velocityPrimed;  // Every channel primed
+        bool _velocityForm;
+};
@@ -0,0 +1,147 @@
+/**************************************************************************************************
+ * PID_Cascade - Two PID_Control loops in cascade
+ * Implementation
+ **************************************************************************************************/
+
+#include "PID_Cascade.h"
+
+PID_Cascade::PID_Cascade(PID_Control& outer, PID_Control& inner) : _outer(outer), _inner(inner) {
+    _outerSensor = nullptr;
+    _innerSensor = nullptr;
+    _ratio = 1;
+    _count = 0;
+    _trackingTime = 0.0;
+}
+
+void PID_Cascade::begin(uint8_t ratio) {
+    _ratio = ratio > 0 ? ratio : 1;
+    
+    if (_inner._useMicros) {
+        _outer.setSampleTimeUs(_inner._sample_time * _ratio);
+    } else {
+        _outer.setSampleTime(_inner._sample_time * _ratio);
+    }
+    
+    // The first inner sample also runs the outer loop, so the inner setpoint is set at once
+    _count = _ratio - 1;
+}
+
+void PID_Cascade::setSensors(SensorCallback outer, SensorCallback inner) {
+    _outerSensor = outer;
+    _innerSensor = inner;
+}
+
+bool PID_Cascade::update() {
+    if (!_innerSensor) return false;
+    
+    // Skip without touching the sensors when the inner loop isn't due
+    unsigned long now = _inner.readClock();
+    if (_inner._enabled && now - _inner._last_time < _inner._sample_time) return false;
+    
+    bool outerDue = _count + 1 >= _ratio;
+    float outerInput = (outerDue && _outerSensor) ? _outerSensor() : 0.0;
+    return step(outerInput, _innerSensor(), outerDue && _outerSensor);
+}
+
+bool PID_Cascade::update(float outerInput, float innerInput) {
+    return step(outerInput, innerInput, true);
+}
+
+bool PID_Cascade::step(float outerInput, float innerInput, bool haveOuter) {
+    unsigned long now = _inner.readClock();
+    
+    // disable() has already forced a disabled loop's output to zero
+    if (!_inner._enabled) {
+        _inner.updateAt(innerInput, now);
+        return false;
+    }
+    if (now - _inner._last_time < _inner._sample_time) return false;
+    
+    if (++_count >= _ratio) {
+        _count = 0;
+        
+        if (haveOuter && _outer._enabled) {
+            // Inner sample count is the outer loop's clock: an outer sample that jitter makes look
+            // early still runs, as exactly one sample time
+            if (now - _outer._last_time < _outer._sample_time) {
+                _outer._last_time = now - _outer._sample_time;
+            }
+            _outer.updateAt(outerInput, now);
+            
+            if (_outer._enabled) {
+                // Windup limit: the outer output as applied, or the inner process value while the
+                // inner loop is saturated in the direction of the new setpoint
+                float applied = _outer._output;
+                bool innerHigh = _inner._output >= _inner._output_max;
+                bool innerLow = _inner._output <= _inner._output_min;
+                bool cantRaise = _inner._polarity ? innerHigh : innerLow;
+                bool cantLower = _inner._polarity ? innerLow : innerHigh;
+                if ((cantRaise && applied > innerInput) || (cantLower && applied < innerInput)) {
+                    applied = innerInput;
+                    if (applied > _outer._output_max) applied = _outer._output_max;
+                    if (applied < _outer._output_min) applied = _outer._output_min;
+                }
+                backCalculate(_outer, applied);
+                
+                _inner.setpoint(_outer._output);
+            }
+        }
+    }
+    
+    _inner.updateAt(innerInput, now);
+    if (_inner._enabled) backCalculate(_inner, _inner._output);
+    return true;
+}
+
+// Move the integral by Ts/Tt of the gap between the output that could be applied and the
+// unclamped PID sum. Positional form only: the velocity form has no integral and winds up
+// against the clamp.
+void PID_Cascade::backCalculate(PID_Control& pid, float applied) {
+    if (_trackingTime < 0.0 || pid._velocityForm || pid._manual || pid._Ki == 0.0) return;
+    
+    // Polarity already applied to the terms, so their sum plus the feed-forward is the output
+    // before clamping (applied, the clamped output or a pv, carries the feed-forward too)
+    float unclamped = pid._P_term + pid._I_term - pid._D_term + pid._feedForward;
+    if (applied == unclamped) return;
+    
+    float tt = _trackingTime;
+    if (tt == 0.0) {
+        float ti = pid._Kp / pid._Ki;
+        float td = pid._Kp != 0.0 ? pid._Kd / pid._Kp : 0.0;
+        tt = td > 0.0 ? sqrt(ti * td) : ti;
+        if (!(tt > 0.0)) return;  // Ti undefined without proportional gain
+    }
+    float gain = pid._sample_time * pid._secondsPerTick / tt;
+    float excess = (gain < 1.0 ? gain : 1.0) * (applied - unclamped);
+    
+    pid._integral += pid._polarity ? excess : -excess;
+    if (pid._integral > pid._integral_max) {
+        pid._integral = pid._integral_max;
+    } else if (pid._integral < pid._integral_min) {
+        pid._integral = pid._integral_min;
+    }
+}
+
+void PID_Cascade::setTrackingTime(float tt) {
+    _trackingTime = tt;
+}
+
+float PID_Cascade::getTrackingTime() {
+    return _trackingTime;
+}
+
+uint8_t PID_Cascade::getRatio() {
+    return _ratio;
+}
+
+bool PID_Cascade::isInnerSaturated() {
+    return _inner._output >= _inner._output_max || _inner._output <= _inner._output_min;
+}
+
+PID_Control& PID_Cascade::getOuter() {
+    return _outer;
+}
+
+PID_Control& PID_Cascade::getInner() {
+    return _inner;
+}
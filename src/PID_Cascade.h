@@ -0,0 +1,61 @@
+/**************************************************************************************************
+ * PID_Cascade - Two PID_Control loops in cascade
+ * 
+ * The outer (primary) loop's output is the inner (secondary) loop's setpoint, e.g. a
+ * temperature loop commanding a heater current loop. One update() call reads the clock once,
+ * runs the inner loop on its sample time and the outer loop on every ratio-th inner sample, so
+ * the two rates never drift apart.
+ * 
+ * Anti-windup by back-calculation on both loops: after each sample the integral moves towards
+ * the value that would have produced the output actually applied, with tracking time constant
+ * Tt. For the outer loop that output is its own clamped output, or the inner process value
+ * while the inner loop is saturated and can't follow a setpoint further out.
+ * 
+ * Give the outer controller pin -1; the inner controller drives the actuator.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <PID_Control.h>
+
+class PID_Cascade {
+    public:
+        // Sensor reading callback, called only when that loop is due
+        using SensorCallback = float (*)();
+        
+        PID_Cascade(PID_Control& outer, PID_Control& inner);
+        
+        // Run the outer loop once per ratio inner samples: sets its sample time (and time base)
+        // to ratio times the inner one. Call after setting the inner sample time.
+        void begin(uint8_t ratio);
+        
+        // Read the sensors through callbacks, so the outer one is only read when it is due
+        void setSensors(SensorCallback outer, SensorCallback inner);
+        
+        // Main update function - call this in your loop(). Returns true if the inner loop ran.
+        bool update();
+        bool update(float outerInput, float innerInput);
+        
+        // Back-calculation tracking time constant in seconds for both loops. 0 (default) uses
+        // each loop's Ti, or sqrt(Ti * Td) with derivative action; negative turns it off.
+        void setTrackingTime(float tt);
+        float getTrackingTime();
+        
+        uint8_t getRatio();
+        bool isInnerSaturated();
+        PID_Control& getOuter();
+        PID_Control& getInner();
+        
+    private:
+        bool step(float outerInput, float innerInput, bool haveOuter);
+        void backCalculate(PID_Control& pid, float applied);
+        
+        PID_Control& _outer;
+        PID_Control& _inner;
+        SensorCallback _outerSensor;
+        SensorCallback _innerSensor;
+        uint8_t _ratio;
+        uint8_t _count;  // Inner samples since the last outer sample
+        float _trackingTime;
+};
@@ -1,4 +1,27 @@
 #include "PID_Control.h"
+#include "PID_GainSchedule.h"
+#include <limits.h>
+
+// _lastDuty before anything has been written
+static const long DUTY_UNSET = LONG_MIN;
+
+#if PID_CONTROL_STATS
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define PID_DWT_CTRL (*(volatile uint32_t*)0xE0001000)
+#define PID_DWT_CYCCNT (*(volatile uint32_t*)0xE0001004)
+#define PID_DEMCR (*(volatile uint32_t*)0xE000EDFC)
+#endif
+
+static inline uint32_t statsCounter() {
+#if defined(ESP32) || defined(ESP8266)
+    return ESP.getCycleCount();
+#elif defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+    return PID_DWT_CYCCNT;
+#else
+    return micros();
+#endif
+}
+#endif
 
 PID_Control::PID_Control(int out_pin, bool polarity) {
     _out_pin = out_pin;
@@ -9,13 +32,16 @@ PID_Control::PID_Control(int out_pin, bool polarity) {
     _Ki = 0.0;
     _Kd = 0.0;
     _setpoint = 0.0;
+    _targetSetpoint = 0.0;
     
     // Internal state variables
     _integral = 0.0;
     _prev_error = 0.0;
     _prev_input = 0.0;
+    _prev_input2 = 0.0;
     _last_error = 0.0;
     _last_time = 0;
+    _outputDelta = 0.0;
     
     // PID components for debugging
     _P_term = 0.0;
@@ -25,7 +51,10 @@ PID_Control::PID_Control(int out_pin, bool polarity) {
     // Initialize safety features
     _staleDataEnabled = false;
     _minRateOfChange = 0.0;
+    _minChangePerTick = 0.0;
+    _staleBand = 0.0;
     _maxStaleTimeMs = 5000;  // Default 5 seconds
+    _maxStaleTime = 5000;
     _lastGoodTime = 0;
     _lastGoodValue = 0.0;
     
@@ -41,11 +70,45 @@ PID_Control::PID_Control(int out_pin, bool polarity) {
     _integral_min = -1000.0;
     _integral_max = 1000.0;
     _sample_time = 100; // milliseconds
+    _useMicros = false;
+    _secondsPerTick = 0.001;
+    _fixedRate = false;
+    _jitterTolerance = 1;
+    _KiTs = 0.0;
+    _KdTs = 0.0;
+    _invTs = 10.0;
+    _filterAlphaTs = 1.0;
+    _rampStepTs = 0.0;
+    _filterTf = 0.0;
+    _D_filtered = 0.0;
+    _rampRate = 0.0;
+    _velocityForm = false;
+    _velocityPrimed = false;
+    _schedule = nullptr;
+    
+    _sampleCallback = nullptr;
+    _sampleContext = nullptr;
+    _outputCallback = nullptr;
+    _outputCallbackContext = nullptr;
+    
+#if PID_CONTROL_STATS
+    resetStats();
+#endif
+    
+    _manual = false;
+    _manualOutput = 0.0;
+    _feedForward = 0.0;
+    _feedForwardApplied = 0.0;
+    _outputSink = nullptr;
+    _outputContext = nullptr;
+    _outputStep = 1.0;
+    _outputScale = 1.0;
+    _lastDuty = DUTY_UNSET;
     
     if (_out_pin >= 0) {
         pinMode(_out_pin, OUTPUT);
-        analogWrite(_out_pin, 0);
     }
+    writeOutput(0.0);
 }
 
 void PID_Control::begin(float Kp, float Ki, float Kd, float setpoint) {
@@ -53,32 +116,74 @@ void PID_Control::begin(float Kp, float Ki, float Kd, float setpoint) {
     _Ki = Ki;
     _Kd = Kd;
     _setpoint = setpoint;
+    _targetSetpoint = setpoint;
+    updateScaledGains();
     
     // Reset internal state
     _integral = 0.0;
+    _D_filtered = 0.0;
     _prev_error = 0.0;
     _prev_input = 0.0;
-    _last_time = millis();
+    _last_time = readClock();
     _output = 0.0;
+    _last_error = 0.0;
     
     enable();
 }
 
 void PID_Control::setpoint(float setpoint) {
-    _setpoint = setpoint;
+    _targetSetpoint = setpoint;
+    if (_rampRate <= 0.0) _setpoint = setpoint;
+}
+
+bool PID_Control::update(float input) {
+    return updateAt(input, readClock());
 }
 
-void PID_Control::update(float input) {
+bool PID_Control::update(float input, uint32_t timestampUs) {
+    unsigned long now = stampTime(timestampUs, readClock(), PID_Hal::micros());
+    if ((long)(now - _last_time) < 0) return false;
+    return updateAt(input, now);
+}
+
+// The clocks are read once for the whole batch
+bool PID_Control::updateMany(const float* inputs, const uint32_t* timestampsUs, size_t count) {
+    unsigned long clock = readClock();
+    uint32_t clockUs = PID_Hal::micros();
+    bool computed = false;
+    for (size_t i = 0; i < count; i++) {
+        unsigned long now = stampTime(timestampsUs[i], clock, clockUs);
+        if ((long)(now - _last_time) < 0) continue;
+        if (updateAt(inputs[i], now)) computed = true;
+    }
+    return computed;
+}
+
+// A micros() timestamp in the time base, as its age back from a clock reading taken at clockUs.
+// Going through the age keeps the millisecond base wrap-safe, micros() / 1000 would wrap apart
+// from millis(). A timestamp after clockUs counts as taken then.
+unsigned long PID_Control::stampTime(uint32_t timestampUs, unsigned long clock, uint32_t clockUs) {
+    uint32_t age = clockUs - timestampUs;
+    if ((int32_t)age < 0) age = 0;
+    return clock - (_useMicros ? age : age / 1000);
+}
+
+// Update using a clock value taken once by the caller (update() or PID_Group), in the
+// controller's time base (millis(), or micros() after setSampleTimeUs()). Returns true when a
+// sample was computed.
+bool PID_Control::updateAt(float input, unsigned long now) {
+#if PID_CONTROL_STATS
+    uint32_t statsStart = statsCounter();
+#endif
+    
     if (!_enabled) {
         _output = 0.0;
         _P_term = 0.0;
         _I_term = 0.0;
         _D_term = 0.0;
         _last_error = 0.0;
-        if (_out_pin >= 0) {
-            analogWrite(_out_pin, 0);
-        }
-        return;
+        writeOutput(0.0);
+        return false;
     }
     
     // Safety checks
@@ -96,29 +201,12 @@ void PID_Control::update(float input) {
         }
     }
     
-    // Check for stale data if enabled (only when away from setpoint)
-    if (_staleDataEnabled && !errorDetected) {
-        float error = _setpoint - input;
-        if (abs(error) > 0.1) {  // Only check when not at setpoint
-            if (_lastGoodTime == 0) {
-                _lastGoodTime = millis();
-                _lastGoodValue = input;
-            } else {
-                unsigned long timeDiff = millis() - _lastGoodTime;
-                float rateOfChange = abs(input - _lastGoodValue) / (timeDiff / 1000.0);
-                
-                if (rateOfChange < _minRateOfChange && timeDiff > _maxStaleTimeMs) {
-                    errorDetected = true;
-                } else if (rateOfChange >= _minRateOfChange) {
-                    _lastGoodTime = millis();
-                    _lastGoodValue = input;
-                }
-            }
-        } else {
-            // At setpoint, reset stale data timer
-            _lastGoodTime = millis();
-            _lastGoodValue = input;
-        }
+    unsigned long time_change = now - _last_time;
+    bool sampleDue = time_change >= _sample_time;
+    
+    // Stale data is only judged on sample ticks, against the tick's timestamp
+    if (_staleDataEnabled && !errorDetected && sampleDue) {
+        errorDetected = isStale(input, now);
     }
     
     // Handle error state
@@ -129,51 +217,120 @@ void PID_Control::update(float input) {
         _P_term = 0.0;
         _I_term = 0.0;
         _D_term = 0.0;
-        if (_out_pin >= 0) {
-            analogWrite(_out_pin, 0);
-        }
-        return;
+        writeOutput(0.0);
+        return false;
     }
     
-    unsigned long now = millis();
-    unsigned long time_change = now - _last_time;
-    
     // Only update if sample time has passed
-    if (time_change >= _sample_time) {
-        // Calculate error
-        float error = _setpoint - input;
-        _last_error = error;
-        
-        // Proportional term
-        _P_term = _Kp * error;
-        
-        // Integral term with windup protection
-        _integral += _Ki * error * (time_change / 1000.0);
+    if (sampleDue) {
+        // In fixed-rate mode an on-time sample uses the cached Ki*Ts and Kd/Ts, so no division
+        bool onTime = _fixedRate && (time_change - _sample_time <= _jitterTolerance);
+        float dt = time_change * _secondsPerTick;
         
-        // Clamp integral to prevent windup
-        if (_integral > _integral_max) {
-            _integral = _integral_max;
-        } else if (_integral < _integral_min) {
-            _integral = _integral_min;
+        // Move a ramping setpoint one step towards the target
+        if (_setpoint != _targetSetpoint) {
+            float step = onTime ? _rampStepTs : _rampRate * dt;
+            if (_targetSetpoint - _setpoint > step) {
+                _setpoint += step;
+            } else if (_setpoint - _targetSetpoint > step) {
+                _setpoint -= step;
+            } else {
+                _setpoint = _targetSetpoint;
+            }
         }
         
-        _I_term = _integral;
-        
-        // Derivative term on measurement (to avoid derivative kick on setpoint change)
-        _D_term = 0.0;
-        if (time_change > 0) {
-            _D_term = _Kd * (input - _prev_input) / (time_change / 1000.0);
+        // Scheduled gains at the pv or the working setpoint
+        if (_schedule) {
+            float kp, ki, kd;
+            float x = _schedule->getSource() == PID_GainSchedule::SOURCE_SETPOINT ? _setpoint : input;
+            if (_schedule->lookup(x, kp, ki, kd)) setTunings(kp, ki, kd);
         }
         
-        // Calculate total output
-        _output = _P_term + _I_term - _D_term; // Note: D is subtracted because we use derivative on measurement
+        // Calculate error
+        float error = _setpoint - input;
+        _last_error = error;
+        float previousOutput = _output;
         
-        // Apply polarity
-        if (!_polarity) {
-            _output = -_output;
-            _P_term = -_P_term;
-            _I_term = -_I_term;
-            _D_term = -_D_term;
+        if (_manual) {
+            // Manual output, e.g. the relay autotuner: the PID terms are not computed
+            _P_term = 0.0;
+            _I_term = 0.0;
+            _D_term = 0.0;
+            _output = _manualOutput;
+        } else {
+            // Derivative on measurement (to avoid derivative kick on setpoint change): its first
+            // difference in positional form, the second in velocity form
+            float change;
+            
+            if (_velocityForm) {
+                // Start from the current output without a kick from stale history
+                if (!_velocityPrimed) {
+                    _prev_error = error;
+                    _prev_input = input;
+                    _prev_input2 = input;
+                    _velocityPrimed = true;
+                }
+                
+                // Each term is its change this sample, the output keeps the sum
+                _P_term = _Kp * (error - _prev_error);
+                _I_term = (onTime ? _KiTs : _Ki * dt) * error;
+                change = pidSecondDifference(input, _prev_input, _prev_input2);
+            } else {
+                // Proportional term
+                _P_term = _Kp * error;
+                
+                // Integral term with windup protection
+                if (onTime) {
+                    _integral += _KiTs * error;
+                } else {
+                    _integral += _Ki * error * dt;
+                }
+                
+                // Clamp integral to prevent windup
+                if (_integral > _integral_max) {
+                    _integral = _integral_max;
+                } else if (_integral < _integral_min) {
+                    _integral = _integral_min;
+                }
+                
+                _I_term = _integral;
+                change = input - _prev_input;
+            }
+            
+            _D_term = 0.0;
+            if (onTime) {
+                _D_term = _KdTs * change;
+            } else if (time_change > 0) {
+                _D_term = _Kd * change / dt;
+            }
+            
+            // Low-pass the derivative, alpha = dt / (tf + dt)
+            if (_filterTf > 0.0) {
+                float alpha = onTime ? _filterAlphaTs : dt / (_filterTf + dt);
+                _D_filtered += alpha * (_D_term - _D_filtered);
+                _D_term = _D_filtered;
+            }
+            
+            // Calculate total output
+            float sum = _P_term + _I_term - _D_term; // Note: D is subtracted because we use derivative on measurement
+            
+            // Apply polarity
+            if (!_polarity) {
+                sum = -sum;
+                _P_term = -_P_term;
+                _I_term = -_I_term;
+                _D_term = -_D_term;
+            }
+            
+            // Velocity form adds to the last (clamped) output, so the clamp is its anti-windup.
+            // Feed-forward is added as is, in output units, whatever the polarity; the velocity
+            // form adds its change.
+            if (_velocityForm) {
+                _output += sum + (_feedForward - _feedForwardApplied);
+            } else {
+                _output = sum + _feedForward;
+            }
+            _feedForwardApplied = _feedForward;
         }
         
         // Clamp output
@@ -183,23 +340,45 @@ void PID_Control::update(float input) {
             _output = _output_min;
         }
         
+        // Manual output tracking: the integral follows it so going back to auto is bumpless
+        if (_manual) {
+            trackOutput();
+            _feedForwardApplied = _feedForward;
+        }
+        
+        _outputDelta = _output - previousOutput;
+        
         // Update state variables
         _prev_error = error;
+        _prev_input2 = _prev_input;
         _prev_input = input;
         _last_time = now;
         
-        // Write to output pin
-        if (_out_pin >= 0) {
-            analogWrite(_out_pin, (int)_output);
+        // Write to output pin or sink
+        writeOutput(_output);
+        
+#if PID_CONTROL_STATS
+        recordStats(statsStart, time_change);
+#endif
+        
+        if (_outputCallback) {
+            _outputCallback(_output, now, _outputCallbackContext);
+        }
+        
+        if (_sampleCallback) {
+            _sampleCallback(_sampleContext);
         }
+        return true;
     }
+    return false;
 }
 
 void PID_Control::enable() {
     _enabled = true;
     _errorState = false;  // Clear error state when enabling
     _lastGoodTime = 0;    // Reset stale data timer
-    _last_time = millis();
+    _last_time = readClock();
+    _velocityPrimed = false;
 }
 
 bool PID_Control::isEnabled() {
@@ -209,20 +388,29 @@ bool PID_Control::isEnabled() {
 void PID_Control::disable() {
     _enabled = false;
     _output = 0.0;
-    if (_out_pin >= 0) {
-        analogWrite(_out_pin, 0);
-    }
+    writeOutput(0.0);
 }
 
 void PID_Control::setPID(float Kp, float Ki, float Kd) {
     _Kp = Kp;
     _Ki = Ki;
     _Kd = Kd;
+    updateScaledGains();
     
     // Reset integral when changing parameters
     _integral = 0.0;
 }
 
+// The integral holds the accumulated I term, not the error sum, so keeping it across a Ki change
+// is bumpless. The cached gains are rescaled without dividing.
+void PID_Control::setTunings(float Kp, float Ki, float Kd) {
+    _Kp = Kp;
+    _Ki = Ki;
+    _Kd = Kd;
+    _KiTs = Ki * _sample_time * _secondsPerTick;
+    _KdTs = Kd * _invTs;
+}
+
 float PID_Control::getKp() {
     return _Kp;
 }
@@ -236,16 +424,68 @@ float PID_Control::getKd() {
 }
 
 float PID_Control::getSetpoint() {
+    return _targetSetpoint;
+}
+
+float PID_Control::getWorkingSetpoint() {
     return _setpoint;
 }
 
+void PID_Control::setGainSchedule(PID_GainSchedule* schedule) {
+    _schedule = schedule;
+}
+
+PID_GainSchedule* PID_Control::getGainSchedule() {
+    return _schedule;
+}
+
 // Safety feature implementations
 void PID_Control::setStaleDataDetection(float minRateOfChange, unsigned long maxTimeMs) {
     _minRateOfChange = minRateOfChange;
+    _minChangePerTick = minRateOfChange * _secondsPerTick;
+    _staleBand = 0.0;
     _maxStaleTimeMs = maxTimeMs;
+    _maxStaleTime = _useMicros ? maxTimeMs * 1000 : maxTimeMs;
     _lastGoodTime = 0;  // Reset timer
 }
 
+void PID_Control::setStaleDataWindow(float band, unsigned long windowMs) {
+    _staleBand = band > 0.0 ? band : 0.0;
+    _maxStaleTimeMs = windowMs;
+    _maxStaleTime = _useMicros ? windowMs * 1000 : windowMs;
+    _lastGoodTime = 0;  // Reset timer
+}
+
+// Stale data check (only when away from setpoint). The rate test is |change| < rate * elapsed,
+// with the rate pre-scaled to time base ticks, so no division. The window test instead needs
+// the input to leave a +/-band around where it was when the window started.
+bool PID_Control::isStale(float input, unsigned long now) {
+    if (abs(_setpoint - input) <= 0.1) {
+        // At setpoint, reset stale data timer
+        _lastGoodTime = now;
+        _lastGoodValue = input;
+        return false;
+    }
+    
+    if (_lastGoodTime == 0) {
+        _lastGoodTime = now;
+        _lastGoodValue = input;
+        return false;
+    }
+    
+    unsigned long timeDiff = now - _lastGoodTime;
+    float change = abs(input - _lastGoodValue);
+    bool changing = _staleBand > 0.0 ? change > _staleBand
+                                     : change >= _minChangePerTick * timeDiff;
+    
+    if (changing) {
+        _lastGoodTime = now;
+        _lastGoodValue = input;
+        return false;
+    }
+    return timeDiff > _maxStaleTime;
+}
+
 void PID_Control::enableStaleDataDetection() {
     _staleDataEnabled = true;
     _lastGoodTime = 0;  // Reset timer
@@ -304,15 +544,224 @@ void PID_Control::setIntegralLimits(float min, float max) {
 
 void PID_Control::setSampleTime(unsigned long sample_time) {
     if (sample_time > 0) {
+        setTimeBase(false);
         _sample_time = sample_time;
+        updateScaledGains();
     }
 }
 
+void PID_Control::setSampleTimeUs(unsigned long sample_time_us) {
+    if (sample_time_us > 0) {
+        setTimeBase(true);
+        _sample_time = sample_time_us;
+        updateScaledGains();
+    }
+}
+
+unsigned long PID_Control::getSampleTimeUs() {
+    return _useMicros ? _sample_time : _sample_time * 1000;
+}
+
+bool PID_Control::isMicros() {
+    return _useMicros;
+}
+
+// Switch between millis() and micros(), restarting the timing in the new base
+void PID_Control::setTimeBase(bool useMicros) {
+    if (useMicros == _useMicros) return;
+    _useMicros = useMicros;
+    _secondsPerTick = useMicros ? 0.000001 : 0.001;
+    _minChangePerTick = _minRateOfChange * _secondsPerTick;
+    _maxStaleTime = useMicros ? _maxStaleTimeMs * 1000 : _maxStaleTimeMs;
+    _last_time = readClock();
+    _lastGoodTime = 0;
+}
+
+unsigned long PID_Control::readClock() {
+    return _useMicros ? PID_Hal::micros() : PID_Hal::millis();
+}
+
+void PID_Control::setFixedRate(bool enabled, unsigned long jitterTolerance) {
+    _fixedRate = enabled;
+    _jitterTolerance = jitterTolerance;
+}
+
+bool PID_Control::isFixedRate() {
+    return _fixedRate;
+}
+
+void PID_Control::setVelocityForm(bool enabled) {
+    if (enabled == _velocityForm) return;
+    _velocityForm = enabled;
+    _velocityPrimed = false;
+    
+    // Back to positional form: seed the integral so the output carries on from where it is
+    if (!enabled) trackOutput();
+}
+
+bool PID_Control::isVelocityForm() {
+    return _velocityForm;
+}
+
+float PID_Control::getOutputDelta() {
+    return _outputDelta;
+}
+
+void PID_Control::setDerivativeFilter(float tf) {
+    _filterTf = tf > 0.0 ? tf : 0.0;
+    updateScaledGains();
+}
+
+float PID_Control::getDerivativeFilter() {
+    return _filterTf;
+}
+
+void PID_Control::setSetpointRamp(float rate) {
+    _rampRate = rate > 0.0 ? rate : 0.0;
+    if (_rampRate == 0.0) _setpoint = _targetSetpoint;  // Finish a ramp in progress
+    updateScaledGains();
+}
+
+float PID_Control::getSetpointRamp() {
+    return _rampRate;
+}
+
+// Cache the discrete-time gains for the configured sample time
+void PID_Control::updateScaledGains() {
+    float ts = _sample_time * _secondsPerTick;
+    _KiTs = _Ki * ts;
+    _invTs = 1.0 / ts;
+    _KdTs = _Kd * _invTs;
+    _filterAlphaTs = ts / (_filterTf + ts);
+    _rampStepTs = _rampRate * ts;
+}
+
+#if PID_CONTROL_STATS
+const PID_Stats& PID_Control::getStats() {
+    return _stats;
+}
+
+float PID_Control::getExecTimeMeanUs() {
+    if (_stats.samples == 0) return 0.0;
+    return (float)_stats.execTotal / _stats.samples / PID_STATS_TICKS_PER_US;
+}
+
+float PID_Control::getDtMean() {
+    if (_stats.samples == 0) return 0.0;
+    return (float)_stats.dtTotal / _stats.samples;
+}
+
+void PID_Control::resetStats() {
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+    // Start the DWT cycle counter (trace enable, then CYCCNTENA)
+    PID_DEMCR |= (1UL << 24);
+    PID_DWT_CTRL |= 1UL;
+#endif
+    _stats.samples = 0;
+    _stats.execMin = 0xFFFFFFFFUL;
+    _stats.execMax = 0;
+    _stats.execTotal = 0;
+    _stats.dtMin = 0xFFFFFFFFUL;
+    _stats.dtMax = 0;
+    _stats.dtTotal = 0;
+    _stats.overruns = 0;
+    _stats.skipped = 0;
+}
+
+// Time spent on a computed sample (excluding the sample callback) and the dt it ran at
+void PID_Control::recordStats(uint32_t start, unsigned long time_change) {
+    uint32_t exec = statsCounter() - start;
+    _stats.samples++;
+    if (exec < _stats.execMin) _stats.execMin = exec;
+    if (exec > _stats.execMax) _stats.execMax = exec;
+    _stats.execTotal += exec;
+    
+    if (time_change < _stats.dtMin) _stats.dtMin = time_change;
+    if (time_change > _stats.dtMax) _stats.dtMax = time_change;
+    _stats.dtTotal += time_change;
+    
+    if (time_change - _sample_time > _jitterTolerance) {
+        _stats.overruns++;
+        _stats.skipped += time_change / _sample_time - 1;
+    }
+}
+#endif
+
+void PID_Control::setManual(bool manual) {
+    // Back to auto from the last manual output
+    if (_manual && !manual) trackOutput();
+    _manual = manual;
+}
+
+bool PID_Control::isManual() {
+    return _manual;
+}
+
+void PID_Control::setManualOutput(float output) {
+    _manualOutput = output;
+}
+
+void PID_Control::setFeedForward(float feedForward) {
+    _feedForward = feedForward;
+}
+
+float PID_Control::getFeedForward() {
+    return _feedForward;
+}
+
+// Seed the integral so the next positional sample reproduces the present output: whatever the
+// proportional term and feed-forward don't account for
+void PID_Control::trackOutput() {
+    float output = _output - _feedForward;
+    _integral = (_polarity ? output : -output) - _Kp * _last_error;
+    if (_integral > _integral_max) {
+        _integral = _integral_max;
+    } else if (_integral < _integral_min) {
+        _integral = _integral_min;
+    }
+    _D_filtered = 0.0;
+}
+
+void PID_Control::setOutputSink(OutputSink sink, void* context) {
+    _outputSink = sink;
+    _outputContext = context;
+    _lastDuty = DUTY_UNSET;  // Always write the next sample
+}
+
+void PID_Control::setOutputResolution(float step) {
+    if (step > 0.0) {
+        _outputStep = step;
+        _outputScale = 1.0 / step;
+        _lastDuty = DUTY_UNSET;
+    }
+}
+
+// Quantize to the output step and write to the sink or pin, only when the duty changed
+void PID_Control::writeOutput(float value) {
+    long duty = (long)(value * _outputScale);
+    if (duty == _lastDuty) return;
+    _lastDuty = duty;
+    
+    if (_outputSink) {
+        _outputSink(duty * _outputStep, _outputContext);
+    } else if (_out_pin >= 0) {
+        PID_Hal::output(_out_pin, (int)duty);
+    }
+}
+
+unsigned long PID_Control::getSampleTime() {
+    return _useMicros ? _sample_time / 1000 : _sample_time;
+}
+
 void PID_Control::reset() {
     _integral = 0.0;
     _prev_error = 0.0;
     _prev_input = 0.0;
-    _last_time = millis();
+    _prev_input2 = 0.0;
+    _D_filtered = 0.0;
+    _velocityPrimed = false;
+    _outputDelta = 0.0;
+    _last_time = readClock();
     _output = 0.0;
     _last_error = 0.0;
     _P_term = 0.0;
@@ -337,3 +786,20 @@ float PID_Control::getError() {
     return _last_error;
 }
 
+float PID_Control::getInput() {
+    return _prev_input;
+}
+
+unsigned long PID_Control::getLastUpdateTime() {
+    return _last_time;
+}
+
+void PID_Control::setSampleCallback(SampleCallback callback, void* context) {
+    _sampleCallback = callback;
+    _sampleContext = context;
+}
+
+void PID_Control::setOutputCallback(OutputCallback callback, void* context) {
+    _outputCallback = callback;
+    _outputCallbackContext = context;
+}
@@ -1,17 +1,73 @@
 #pragma once
 
 #include <Arduino.h>
+#include <PID_Hal.h>
+#include <PID_Velocity.h>
+
+// Instrumentation of update(): build with -DPID_CONTROL_STATS=1 (it changes the class
+// layout, so it must be set for the whole build, not just the sketch). Compiled out otherwise.
+#ifndef PID_CONTROL_STATS
+#define PID_CONTROL_STATS 0
+#endif
+
+#if PID_CONTROL_STATS
+// Execution time counter: CPU cycles on Cortex-M3/M4/M7 (DWT) and ESP, micros() elsewhere
+#if defined(ESP32) || defined(ESP8266) || defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define PID_STATS_CYCLES 1
+#define PID_STATS_TICKS_PER_US (F_CPU / 1000000UL)
+#else
+#define PID_STATS_CYCLES 0
+#define PID_STATS_TICKS_PER_US 1
+#endif
+
+// Figures for the computed samples since the last resetStats()
+struct PID_Stats {
+    unsigned long samples;
+    uint32_t execMin;        // Counter ticks (PID_STATS_TICKS_PER_US per microsecond)
+    uint32_t execMax;
+    uint64_t execTotal;
+    unsigned long dtMin;     // Time base ticks (ms or us)
+    unsigned long dtMax;
+    uint64_t dtTotal;
+    unsigned long overruns;  // Samples later than the sample time plus the jitter tolerance
+    unsigned long skipped;   // Whole sample periods missed by those late samples
+};
+#endif
+
+class PID_GainSchedule;
 
 class PID_Control {
     public: 
+        // Called after every computed sample (not on calls skipped by the sample time)
+        using SampleCallback = void (*)(void* context);
+        
+        // Receives the quantized output in place of analogWrite()
+        using OutputSink = void (*)(float output, void* context);
+        
+        // Receives every computed output with its sample time (in the controller's time base),
+        // whether or not the duty changed
+        using OutputCallback = void (*)(float output, unsigned long time, void* context);
+        
         PID_Control(int out_pin, bool polarity);
         void begin(float Kp, float Ki, float Kd, float setpoint);
         void setpoint(float setpoint);
-        void update(float input);
+        // Each update returns true when it computed a new output, false when the sample time
+        // hadn't elapsed, the controller is disabled or the input failed a safety check
+        bool update(float input);
+        
+        // Input sampled at timestampUs on the micros() clock (PID_Hal::micros()), e.g. by a DMA
+        // ADC: the sample time is judged at the timestamp rather than at the call. Inputs older
+        // than the last computed sample are ignored.
+        bool update(float input, uint32_t timestampUs);
+        
+        // A batch of timestamped inputs, oldest first; true if any of them computed an output
+        bool updateMany(const float* inputs, const uint32_t* timestampsUs, size_t count);
         void enable();
         bool isEnabled();
         void disable();
         void setPID(float Kp, float Ki, float Kd);
+        // Change the gains keeping the integral, so the output doesn't bump (setPID() resets it)
+        void setTunings(float Kp, float Ki, float Kd);
         float getKp();
         float getKi();
         float getKd();
@@ -23,9 +79,41 @@ class PID_Control {
         float getIntegral();
         float getDerivative();
         float getError();
+        float getInput();
+        unsigned long getLastUpdateTime();  // In the controller's time base (ms or us)
+        
+        // Sample observer, e.g. PID_Tune's on-device capture
+        void setSampleCallback(SampleCallback callback, void* context = nullptr);
+        
+        // Output observer, e.g. to queue each output of a batch (called before the sample callback)
+        void setOutputCallback(OutputCallback callback, void* context = nullptr);
+        
+        // Manual mode: samples keep their timing, safety checks and callbacks but output the
+        // manual value (clamped to the output limits) instead of the PID result. The integral
+        // tracks the manual output, so going back to auto carries on from it without a bump.
+        void setManual(bool manual);
+        bool isManual();
+        void setManualOutput(float output);
+        
+        // Feed-forward in output units, added to the PID result each sample (not to the manual
+        // output), e.g. a known load; it stays until changed
+        void setFeedForward(float feedForward);
+        float getFeedForward();
+        
+        // Output sink, e.g. direct LEDC/TCC duty registers, a DAC or a batch buffer; nullptr
+        // goes back to analogWrite() on the pin
+        void setOutputSink(OutputSink sink, void* context = nullptr);
+        
+        // Output quantization (default 1, whole analogWrite() counts). The pin or sink is only
+        // written when the output moves to another step.
+        void setOutputResolution(float step);
         
         // Safety features
         void setStaleDataDetection(float minRateOfChange, unsigned long maxTimeMs);
+        // Windowed variant for quantized inputs: stale when the input stays within +/-band
+        // (e.g. a couple of ADC counts) for windowMs. setStaleDataDetection() goes back to the
+        // rate test.
+        void setStaleDataWindow(float band, unsigned long windowMs);
         void enableStaleDataDetection();
         void disableStaleDataDetection();
         void setSafeValueLimits(float minValue, float maxValue);
@@ -38,14 +126,71 @@ class PID_Control {
         void setOutputLimits(float min, float max);
         void setIntegralLimits(float min, float max);
         void setSampleTime(unsigned long sample_time);
+        unsigned long getSampleTime();
+        
+        // Microsecond sample time for high-rate loops: timing then runs on micros() (wrap-safe)
+        // until setSampleTime() selects milliseconds again
+        void setSampleTimeUs(unsigned long sample_time_us);
+        unsigned long getSampleTimeUs();
+        bool isMicros();
+        
+        // Fixed-rate mode: samples at most jitterTolerance late (ms, or us on the micros() time
+        // base) use Ki*Ts and Kd/Ts cached by setPID()/setSampleTime() instead of dividing by dt
+        void setFixedRate(bool enabled, unsigned long jitterTolerance = 1);
+        bool isFixedRate();
+        
+        // Velocity (incremental) form: each sample adds du = Kp*de + Ki*e*dt - Kd*d2y/dt to the
+        // last output. The output clamp is the anti-windup (integral limits are unused) and
+        // setPID() doesn't bump the output. P, I and D then report their share of du.
+        void setVelocityForm(bool enabled);
+        bool isVelocityForm();
+        float getOutputDelta();  // Output change at the last computed sample, e.g. for steppers
+        
+        // First-order low-pass on the derivative term with time constant tf seconds (0 = off)
+        void setDerivativeFilter(float tf);
+        float getDerivativeFilter();
+        
+        // Setpoint ramp: setpoint() sets the target and the working setpoint moves towards it by
+        // at most rate units per second, one step per computed sample (0 = step changes)
+        void setSetpointRamp(float rate);
+        float getSetpointRamp();
+        float getWorkingSetpoint();  // getSetpoint() returns the target
+        
+        // Gains looked up from a breakpoint table at every computed sample, with setTunings();
+        // nullptr goes back to fixed gains. The schedule must outlive its use here.
+        void setGainSchedule(PID_GainSchedule* schedule);
+        PID_GainSchedule* getGainSchedule();
         void reset();
+        
+#if PID_CONTROL_STATS
+        const PID_Stats& getStats();
+        float getExecTimeMeanUs();
+        float getDtMean();  // In the time base
+        void resetStats();
+#endif
 
     private:
+        friend class PID_Group;
+        friend class PID_Timer;
+        friend class PID_Autotune;
+        friend class PID_Cascade;
+        friend class PID_Storage;
+        
+        bool updateAt(float input, unsigned long now);
+        unsigned long stampTime(uint32_t timestampUs, unsigned long clock, uint32_t clockUs);
+        void updateScaledGains();
+        bool isStale(float input, unsigned long now);
+        void setTimeBase(bool useMicros);
+        unsigned long readClock();
+        void writeOutput(float value);
+        void trackOutput();
+        
         int _out_pin;
         float _Kp;
         float _Ki;
         float _Kd;
-        float _setpoint;
+        float _setpoint;        // Working setpoint the error is computed from
+        float _targetSetpoint;  // Where a setpoint ramp is heading
         bool _polarity;
         bool _enabled;
         float _output;
@@ -54,7 +199,9 @@ class PID_Control {
         float _integral;
         float _prev_error;
         float _prev_input;
+        float _prev_input2;  // Input two samples back, for the velocity form
         float _last_error;  // Store for proportional term access
+        float _outputDelta;
         unsigned long _last_time;
         
         // PID components for debugging
@@ -65,7 +212,10 @@ class PID_Control {
         // Safety feature variables
         bool _staleDataEnabled;
         float _minRateOfChange;
+        float _minChangePerTick;  // Rate scaled to time base ticks
+        float _staleBand;  // 0 = rate test
         unsigned long _maxStaleTimeMs;
+        unsigned long _maxStaleTime;  // In time base ticks
         unsigned long _lastGoodTime;
         float _lastGoodValue;
         
@@ -80,5 +230,54 @@ class PID_Control {
         float _output_max;
         float _integral_min;
         float _integral_max;
-        unsigned long _sample_time;
+        unsigned long _sample_time;  // In time base ticks
+        
+        // Time base
+        bool _useMicros;
+        float _secondsPerTick;
+        
+        // Fixed-rate mode
+        bool _fixedRate;
+        unsigned long _jitterTolerance;
+        float _KiTs;
+        float _KdTs;
+        float _invTs;          // 1 / sample time in seconds
+        float _filterAlphaTs;  // Derivative filter coefficient at the sample time
+        float _rampStepTs;     // Setpoint ramp step at the sample time
+        
+        // Derivative filter and setpoint ramp
+        float _filterTf;
+        float _D_filtered;
+        float _rampRate;
+        
+        // Velocity form
+        bool _velocityForm;
+        bool _velocityPrimed;  // History is valid, cleared by enable() and reset()
+        
+        PID_GainSchedule* _schedule;
+        
+        SampleCallback _sampleCallback;
+        void* _sampleContext;
+        OutputCallback _outputCallback;
+        void* _outputCallbackContext;
+        
+        // Manual mode
+        bool _manual;
+        float _manualOutput;
+        
+        // Feed-forward, and the part of it in the velocity form's output
+        float _feedForward;
+        float _feedForwardApplied;
+        
+        // Output
+        OutputSink _outputSink;
+        void* _outputContext;
+        float _outputStep;
+        float _outputScale;  // 1 / _outputStep
+        long _lastDuty;      // Last written duty in output steps
+        
+#if PID_CONTROL_STATS
+        PID_Stats _stats;
+        void recordStats(uint32_t start, unsigned long time_change);
+#endif
 };
\ No newline at end of file
@@ -0,0 +1,472 @@
+/**************************************************************************************************
+ * PID_ControlT - PID_Control on a selectable number type
+ * 
+ * Same API and safety features as PID_Control, templated on the arithmetic type so FPU-less
+ * MCUs can run the loop in fixed point:
+ * 
+ *     PID_ControlT<q16_16> pid(3, true);   // or PID_ControlFixed
+ *     pid.begin(2.0, 0.5, 0.1, 25.0);
+ *     pid.update(q16_16::fromRaw(reading << 6));
+ * 
+ * Gains, limits and setpoints are still given as float; they are converted, and Ki*Ts and
+ * Kd/Ts are precomputed, when set. update() then only does multiply-adds in T. The integral
+ * and derivative assume each sample is one sample time apart, so call update() at least as
+ * often as the sample time. Header-only.
+ * 
+ * Features can be compiled out with the policies in PID_Policies.h; the defaults give the full
+ * controller:
+ * 
+ *     PID_ControlT<q16_16, PID_Safety::None, PID_Derivative::OnMeasurement, PID_Output::None> pid(-1, true);
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <PID_Hal.h>
+#include <PID_Velocity.h>
+#include <PID_Policies.h>
+
+// Signed Q16.16 fixed point: range +/-32768, resolution 1/65536. Arithmetic saturates.
+struct q16_16 {
+    int32_t raw;
+    
+    q16_16() : raw(0) {}
+    q16_16(int value) : raw(saturate((int64_t)value * 65536)) {}
+    q16_16(long value) : raw(saturate((int64_t)value * 65536)) {}
+    q16_16(float value) : raw(fromFloatRaw(value)) {}
+    q16_16(double value) : raw(fromFloatRaw((float)value)) {}
+    
+    static q16_16 fromRaw(int32_t raw) {
+        q16_16 q;
+        q.raw = raw;
+        return q;
+    }
+    
+    explicit operator float() const { return raw / 65536.0f; }
+    explicit operator int() const { return (int)(raw >> 16); }
+    explicit operator long() const { return (long)(raw >> 16); }
+    
+    q16_16 operator-() const { return fromRaw(raw == INT32_MIN ? INT32_MAX : -raw); }
+    q16_16& operator+=(q16_16 other) { raw = saturate((int64_t)raw + other.raw); return *this; }
+    q16_16& operator-=(q16_16 other) { raw = saturate((int64_t)raw - other.raw); return *this; }
+    
+    friend q16_16 operator+(q16_16 a, q16_16 b) { return a += b; }
+    friend q16_16 operator-(q16_16 a, q16_16 b) { return a -= b; }
+    friend q16_16 operator*(q16_16 a, q16_16 b) {
+        // Round to nearest before dropping the extra 16 fraction bits
+        return fromRaw(saturate(((int64_t)a.raw * b.raw + 0x8000) >> 16));
+    }
+    friend q16_16 operator*(q16_16 a, long n) { return fromRaw(saturate((int64_t)a.raw * n)); }
+    
+    friend bool operator<(q16_16 a, q16_16 b) { return a.raw < b.raw; }
+    friend bool operator>(q16_16 a, q16_16 b) { return a.raw > b.raw; }
+    friend bool operator<=(q16_16 a, q16_16 b) { return a.raw <= b.raw; }
+    friend bool operator>=(q16_16 a, q16_16 b) { return a.raw >= b.raw; }
+    friend bool operator==(q16_16 a, q16_16 b) { return a.raw == b.raw; }
+    friend bool operator!=(q16_16 a, q16_16 b) { return a.raw != b.raw; }
+    
+    private:
+        static int32_t saturate(int64_t value) {
+            if (value > INT32_MAX) return INT32_MAX;
+            if (value < INT32_MIN) return INT32_MIN;
+            return (int32_t)value;
+        }
+        
+        static int32_t fromFloatRaw(float value) {
+            float scaled = value * 65536.0f;
+            if (!(scaled == scaled)) return 0;  // NaN
+            if (scaled >= 2147483647.0f) return INT32_MAX;
+            if (scaled <= -2147483648.0f) return INT32_MIN;
+            return (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+        }
+};
+
+// NaN check that compiles away for types that can't hold NaN
+inline bool pidIsInvalid(float value) { return isnan(value); }
+inline bool pidIsInvalid(q16_16) { return false; }
+
+// Integral accumulator: Ki*Ts and the running sum, in T
+template <typename T>
+struct PID_Integrator {
+    T gain;  // Ki*Ts
+    T sum;
+    
+    void setGain(float kiTs) { gain = T(kiTs); }
+    void add(T error) { sum += gain * error; }
+    T take(T error) { return gain * error; }  // One sample's share, for the velocity form
+    T value() const { return sum; }
+    void set(T value) { sum = value; }
+    void clamp(T min, T max) {
+        if (sum > max) sum = max;
+        else if (sum < min) sum = min;
+    }
+};
+
+// For Q16.16, Ki*Ts and the sum keep 32 fraction bits. Fixed point is mostly run at fast sample
+// rates, where Ki*Ts is tiny: Ki = 0.02 at 1 ms gives 2e-5, about one Q16.16 step. Stored in
+// Q16.16 it would be off by tens of percent or round to 0. With 32 fraction bits the resolution
+// is 2^-32 (2.3e-10); a smaller Ki*Ts still gives no integral action.
+template <>
+struct PID_Integrator<q16_16> {
+    int64_t gain;  // Ki*Ts, 32 fraction bits, |Ki*Ts| < 32768
+    int64_t sum;   // 32 fraction bits, within the Q16.16 range
+    
+    void setGain(float kiTs) {
+        float scaled = kiTs * 4294967296.0f;
+        if (!(scaled == scaled)) scaled = 0.0f;
+        if (scaled > 1.4e14f) scaled = 1.4e14f;
+        if (scaled < -1.4e14f) scaled = -1.4e14f;
+        gain = (int64_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+    }
+    void add(q16_16 error) {
+        sum += increment(error);
+        clamp(q16_16::fromRaw(INT32_MIN), q16_16::fromRaw(INT32_MAX));
+    }
+    q16_16 take(q16_16 error) {
+        // Hand out the whole Q16.16 steps and keep the remainder for the next sample
+        sum += increment(error);
+        int64_t steps = sum >> 16;
+        if (steps > INT32_MAX) steps = INT32_MAX;
+        if (steps < INT32_MIN) steps = INT32_MIN;
+        sum -= steps * 65536;
+        return q16_16::fromRaw((int32_t)steps);
+    }
+    q16_16 value() const {
+        int64_t raw = (sum + 0x8000) >> 16;
+        return q16_16::fromRaw(raw > INT32_MAX ? INT32_MAX : (int32_t)raw);
+    }
+    void set(q16_16 value) { sum = (int64_t)value.raw * 65536; }
+    void clamp(q16_16 min, q16_16 max) {
+        // Multiplied, not shifted: a left shift of a negative value is undefined before C++20
+        int64_t high = (int64_t)max.raw * 65536;
+        int64_t low = (int64_t)min.raw * 65536;
+        if (sum > high) sum = high;
+        else if (sum < low) sum = low;
+    }
+    
+    private:
+        // gain * error in 32 fraction bits without overflowing 64 bits: exact for a gain below
+        // 0.5, the gain's low 16 bits dropped above (still 2^-16 of it at most)
+        int64_t increment(q16_16 error) const {
+            if (gain > -(1LL << 31) && gain < (1LL << 31)) return (gain * error.raw) >> 16;
+            return (gain >> 16) * error.raw;
+        }
+};
+
+template <typename T,
+          typename Safety = PID_Safety::Full,
+          typename Derivative = PID_Derivative::OnMeasurement,
+          typename Output = PID_Output::Pin,
+          typename Direction = PID_Direction::Runtime>
+class PID_ControlT : private PID_OutputState<T, Output>,
+                     private PID_DirectionState<Direction>,
+                     private PID_RangeState<T, Safety::range>,
+                     private PID_StaleState<T, Safety::stale> {
+    public:
+        // out_pin is only used by PID_Output::Pin, polarity only by PID_Direction::Runtime
+        PID_ControlT(int out_pin, bool polarity) {
+            _enabled = false;
+            _Kp = 0.0;
+            _Ki = 0.0;
+            _Kd = 0.0;
+            _integral.setGain(0.0f);
+            _KdTs = T(0.0f);
+            _setpoint = T(0.0f);
+            _output = T(0.0f);
+            
+            _integral.set(T(0.0f));
+            _prev_input = T(0.0f);
+            _prev_input2 = T(0.0f);
+            _prev_error = T(0.0f);
+            _last_error = T(0.0f);
+            _last_time = 0;
+            _velocityForm = false;
+            _velocityPrimed = false;
+            
+            _P_term = T(0.0f);
+            _I_term = T(0.0f);
+            _D_term = T(0.0f);
+            
+            this->initDirection(polarity);
+            this->initStale();
+            this->initRange();
+            
+            _errorState = false;
+            
+            _output_min = T(0.0f);
+            _output_max = T(255.0f);
+            _integral_min = T(-1000.0f);
+            _integral_max = T(1000.0f);
+            _sample_time = 100; // milliseconds
+            
+            this->initOutput(out_pin);
+        }
+        
+        void begin(float Kp, float Ki, float Kd, float setpoint) {
+            _setpoint = T(setpoint);
+            setPID(Kp, Ki, Kd);
+            _prev_input = T(0.0f);
+            _last_time = PID_Hal::millis();
+            _output = T(0.0f);
+            enable();
+        }
+        
+        void setpoint(float setpoint) { _setpoint = T(setpoint); }
+        
+        // Returns true when it computed a new output, as PID_Control::update()
+        bool update(T input) {
+            if (!_enabled) {
+                _output = _P_term = _I_term = _D_term = _last_error = T(0.0f);
+                this->writeOutput(T(0.0f));
+                return false;
+            }
+            
+            unsigned long now = PID_Hal::millis();
+            unsigned long time_change = now - _last_time;
+            bool sampleDue = time_change >= _sample_time;
+            T error = _setpoint - input;
+            
+            // Safety checks, each folds away when the Safety policy leaves it out. Stale data is
+            // only judged on sample ticks, against the tick's timestamp (as in PID_Control).
+            bool errorDetected = Safety::nan && pidIsInvalid(input);
+            if (Safety::range && !errorDetected) {
+                errorDetected = this->rangeFault(input);
+            }
+            if (Safety::stale && !errorDetected && sampleDue) {
+                errorDetected = this->staleFault(error, input, now);
+            }
+            
+            if (errorDetected) {
+                _errorState = true;
+                disable();
+                _P_term = _I_term = _D_term = T(0.0f);
+                return false;
+            }
+            
+            if (!sampleDue) return false;
+            
+            _last_error = error;
+            T signal = Derivative::signal(input, error);
+            
+            if (_velocityForm) {
+                if (!_velocityPrimed) {
+                    _prev_error = error;
+                    _prev_input = _prev_input2 = signal;
+                    _velocityPrimed = true;
+                }
+                
+                // Changes of each term, summed onto the last output
+                _P_term = _Kp_t * (error - _prev_error);
+                _I_term = _integral.take(error);
+                T delta = _P_term + _I_term;
+                if (Derivative::enabled) {
+                    _D_term = _KdTs * pidSecondDifference(signal, _prev_input, _prev_input2);
+                    delta -= _D_term;
+                }
+                
+                if (!this->isDirect()) {
+                    delta = -delta;
+                    _P_term = -_P_term;
+                    _I_term = -_I_term;
+                    _D_term = -_D_term;
+                }
+                _output += delta;
+            } else {
+                _P_term = _Kp_t * error;
+                
+                _integral.add(error);
+                _integral.clamp(_integral_min, _integral_max);
+                _I_term = _integral.value();
+                
+                _output = _P_term + _I_term;
+                if (Derivative::enabled) {
+                    _D_term = _KdTs * (signal - _prev_input);
+                    _output -= _D_term;
+                }
+                
+                if (!this->isDirect()) {
+                    _output = -_output;
+                    _P_term = -_P_term;
+                    _I_term = -_I_term;
+                    _D_term = -_D_term;
+                }
+            }
+            
+            if (_output > _output_max) _output = _output_max;
+            else if (_output < _output_min) _output = _output_min;
+            
+            _prev_error = error;
+            _prev_input2 = _prev_input;
+            _prev_input = signal;
+            _last_time = now;
+            
+            this->writeOutput(_output);
+            return true;
+        }
+        
+        void enable() {
+            _enabled = true;
+            _errorState = false;
+            this->restartStale();
+            _last_time = PID_Hal::millis();
+            _velocityPrimed = false;
+        }
+        
+        bool isEnabled() { return _enabled; }
+        
+        void disable() {
+            _enabled = false;
+            _output = T(0.0f);
+            this->writeOutput(T(0.0f));
+        }
+        
+        void setPID(float Kp, float Ki, float Kd) {
+            _Kp = Kp;
+            _Ki = Ki;
+            _Kd = Kd;
+            _integral.set(T(0.0f));
+            updateScaledGains();
+        }
+        
+        // Velocity (incremental) form, see PID_Control::setVelocityForm()
+        void setVelocityForm(bool enabled) {
+            if (enabled == _velocityForm) return;
+            _velocityForm = enabled;
+            _velocityPrimed = false;
+            if (enabled) _integral.set(T(0.0f));  // Holds the velocity form's sub-step remainder
+            if (!enabled) {
+                // Seed the integral so the positional output carries on from where it is
+                _integral.set((this->isDirect() ? _output : -_output) - _Kp_t * _last_error);
+                _integral.clamp(_integral_min, _integral_max);
+            }
+        }
+        bool isVelocityForm() { return _velocityForm; }
+        
+        float getKp() { return _Kp; }
+        float getKi() { return _Ki; }
+        float getKd() { return _Kd; }
+        T getSetpoint() { return _setpoint; }
+        T getOutput() { return _output; }
+        T getProportional() { return _P_term; }
+        T getIntegral() { return _I_term; }
+        T getDerivative() { return _D_term; }
+        T getError() { return _last_error; }
+        
+        // Where PID_Output::Sink writes the output: called with the clamped output after every
+        // computed sample and with 0 on disable (as PID_Control::setOutputSink())
+        using OutputSink = void (*)(T output, void* context);
+        void setOutputSink(OutputSink sink, void* context = nullptr) {
+            static_assert(Output::sink, "setOutputSink() needs PID_Output::Sink");
+            this->_outputSink = sink;
+            this->_outputContext = context;
+        }
+        
+        // Safety features
+        void setStaleDataDetection(float minRateOfChange, unsigned long maxTimeMs) {
+            static_assert(Safety::stale, "stale data detection is compiled out by the Safety policy");
+            this->_minRateOfChange = minRateOfChange;
+            this->_minChangePerMs = T(minRateOfChange / 1000.0f);
+            this->_maxStaleTimeMs = maxTimeMs;
+            this->restartStale();
+        }
+        void enableStaleDataDetection() {
+            static_assert(Safety::stale, "stale data detection is compiled out by the Safety policy");
+            this->_staleDataEnabled = true;
+            this->restartStale();
+        }
+        void disableStaleDataDetection() {
+            static_assert(Safety::stale, "stale data detection is compiled out by the Safety policy");
+            this->_staleDataEnabled = false;
+        }
+        void setSafeValueLimits(float minValue, float maxValue) {
+            static_assert(Safety::range, "safe value limits are compiled out by the Safety policy");
+            this->_safeMinValue = T(minValue);
+            this->_safeMaxValue = T(maxValue);
+        }
+        void enableSafeValueLimits() {
+            static_assert(Safety::range, "safe value limits are compiled out by the Safety policy");
+            this->_safeValueEnabled = true;
+        }
+        void disableSafeValueLimits() {
+            static_assert(Safety::range, "safe value limits are compiled out by the Safety policy");
+            this->_safeValueEnabled = false;
+        }
+        bool isInErrorState() { return _errorState; }
+        void clearErrorState() { _errorState = false; this->restartStale(); }
+        
+        void setOutputLimits(float min, float max) {
+            if (min >= max) return;
+            _output_min = T(min);
+            _output_max = T(max);
+            if (_output > _output_max) _output = _output_max;
+            else if (_output < _output_min) _output = _output_min;
+        }
+        
+        void setIntegralLimits(float min, float max) {
+            if (min >= max) return;
+            _integral_min = T(min);
+            _integral_max = T(max);
+            _integral.clamp(_integral_min, _integral_max);
+        }
+        
+        void setSampleTime(unsigned long sample_time) {
+            if (sample_time > 0) {
+                _sample_time = sample_time;
+                updateScaledGains();
+            }
+        }
+        
+        unsigned long getSampleTime() { return _sample_time; }
+        
+        void reset() {
+            _prev_input = _prev_input2 = _prev_error = _output = _last_error = T(0.0f);
+            _integral.set(T(0.0f));
+            _P_term = _I_term = _D_term = T(0.0f);
+            _last_time = PID_Hal::millis();
+            _velocityPrimed = false;
+        }
+        
+    private:
+        // Fold the sample time into the gains so update() needs no division
+        void updateScaledGains() {
+            float ts = _sample_time / 1000.0f;
+            _Kp_t = T(_Kp);
+            _integral.setGain(_Ki * ts);
+            _KdTs = Derivative::enabled ? T(_Kd / ts) : T(0.0f);
+        }
+        
+        bool _enabled;
+        
+        // Gains as given, and scaled for the hot path
+        float _Kp;
+        float _Ki;
+        float _Kd;
+        T _Kp_t;
+        T _KdTs;
+        
+        T _setpoint;
+        T _output;
+        PID_Integrator<T> _integral;  // With Ki*Ts
+        T _prev_input;   // Last two derivative signals (input, or -error for OnError)
+        T _prev_input2;
+        T _prev_error;
+        T _last_error;
+        unsigned long _last_time;
+        
+        bool _velocityForm;
+        bool _velocityPrimed;
+        
+        T _P_term;
+        T _I_term;
+        T _D_term;
+        
+        bool _errorState;
+        
+        T _output_min;
+        T _output_max;
+        T _integral_min;
+        T _integral_max;
+        unsigned long _sample_time;
+};
+
+using PID_ControlFixed = PID_ControlT<q16_16>;
@@ -0,0 +1,20 @@
+/**************************************************************************************************
+ * PID_Crc - CRC-16/CCITT-FALSE
+ * 
+ * Shared by PID_Tune's binary frames and PID_Storage's parameter blobs. Bitwise to avoid a
+ * 512 byte table on small parts. Header-only.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#define PID_CRC16_INIT 0xFFFF
+
+inline uint16_t pidCrc16Update(uint16_t crc, uint8_t data) {
+    crc ^= (uint16_t)data << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
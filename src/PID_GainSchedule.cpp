@@ -0,0 +1,105 @@
+/**************************************************************************************************
+ * PID_GainSchedule - Gains interpolated from a breakpoint table
+ * Implementation
+ **************************************************************************************************/
+
+#include "PID_GainSchedule.h"
+
+PID_GainSchedule::PID_GainSchedule() {
+    _count = 0;
+    _segment = 0;
+    _source = SOURCE_INPUT;
+}
+
+void PID_GainSchedule::clear() {
+    _count = 0;
+    _segment = 0;
+}
+
+bool PID_GainSchedule::addPoint(float x, float kp, float ki, float kd) {
+    if (isnan(x)) return false;
+    
+    uint8_t i = 0;
+    while (i < _count && _points[i].x < x) i++;
+    
+    if (i == _count || _points[i].x != x) {
+        if (_count >= PID_GAIN_SCHEDULE_SIZE) return false;
+        for (uint8_t j = _count; j > i; j--) {
+            _points[j] = _points[j - 1];
+        }
+        _count++;
+    }
+    
+    _points[i].x = x;
+    _points[i].kp = kp;
+    _points[i].ki = ki;
+    _points[i].kd = kd;
+    
+    updateSlopes();
+    return true;
+}
+
+uint8_t PID_GainSchedule::size() {
+    return _count;
+}
+
+const PID_GainSchedule::Point& PID_GainSchedule::getPoint(uint8_t index) {
+    return _points[index < _count ? index : 0];
+}
+
+void PID_GainSchedule::setSource(Source source) {
+    _source = source;
+}
+
+PID_GainSchedule::Source PID_GainSchedule::getSource() {
+    return _source;
+}
+
+bool PID_GainSchedule::lookup(float x, float& kp, float& ki, float& kd) {
+    if (_count == 0) return false;
+    
+    const Point* p;
+    if (_count == 1 || !(x > _points[0].x)) {
+        // Below the table (or NaN): first gains
+        _segment = 0;
+        p = &_points[0];
+        x = p->x;
+    } else if (x >= _points[_count - 1].x) {
+        _segment = _count - 2;
+        p = &_points[_count - 1];
+        x = p->x;
+    } else {
+        // Walk from the cached segment; usually it still holds x
+        uint8_t s = _segment < _count - 1 ? _segment : 0;
+        while (x < _points[s].x) s--;
+        while (x >= _points[s + 1].x) s++;
+        _segment = s;
+        p = &_points[s];
+    }
+    
+    float dx = x - p->x;
+    const Slope& slope = _slopes[p - _points];
+    kp = p->kp + slope.kp * dx;
+    ki = p->ki + slope.ki * dx;
+    kd = p->kd + slope.kd * dx;
+    return true;
+}
+
+uint8_t PID_GainSchedule::getSegment() {
+    return _segment;
+}
+
+// Divisions happen here, when the table changes, not at lookup
+void PID_GainSchedule::updateSlopes() {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (i + 1 < _count) {
+            float dx = _points[i + 1].x - _points[i].x;
+            _slopes[i].kp = (_points[i + 1].kp - _points[i].kp) / dx;
+            _slopes[i].ki = (_points[i + 1].ki - _points[i].ki) / dx;
+            _slopes[i].kd = (_points[i + 1].kd - _points[i].kd) / dx;
+        } else {
+            _slopes[i].kp = _slopes[i].ki = _slopes[i].kd = 0.0;
+        }
+    }
+    if (_segment + 1 >= _count) _segment = 0;
+}
@@ -0,0 +1,69 @@
+/**************************************************************************************************
+ * PID_GainSchedule - Gains interpolated from a breakpoint table
+ * 
+ * A sorted table of (x, Kp, Ki, Kd) breakpoints on the process value or the setpoint, e.g. a
+ * furnace tuned at 200 and at 1000 degrees. Attached with PID_Control::setGainSchedule(), the
+ * controller looks up its gains at each sample, interpolating linearly between breakpoints and
+ * holding the end gains outside the table.
+ * 
+ * The per-segment slopes are computed when the table changes and the segment of the last lookup
+ * is cached, so a lookup on a slowly moving input is a compare and three multiply-adds. Gains
+ * change without resetting the integral, so the output doesn't bump.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+// Maximum number of breakpoints
+#ifndef PID_GAIN_SCHEDULE_SIZE
+#define PID_GAIN_SCHEDULE_SIZE 8
+#endif
+
+class PID_GainSchedule {
+    public:
+        // What the table is indexed by
+        enum Source : uint8_t {
+            SOURCE_INPUT,     // Process value
+            SOURCE_SETPOINT   // Working setpoint, so the gains don't follow measurement noise
+        };
+        
+        struct Point {
+            float x;
+            float kp;
+            float ki;
+            float kd;
+        };
+        
+        PID_GainSchedule();
+        
+        void clear();
+        
+        // Insert a breakpoint in order; one at the same x is replaced. False when the table is full.
+        bool addPoint(float x, float kp, float ki, float kd);
+        uint8_t size();
+        const Point& getPoint(uint8_t index);
+        
+        void setSource(Source source);
+        Source getSource();
+        
+        // Gains at x; false (gains untouched) while the table is empty
+        bool lookup(float x, float& kp, float& ki, float& kd);
+        uint8_t getSegment();  // Segment of the last lookup, 0 .. size() - 2
+        
+    private:
+        // Gain change per unit of x from a point to the next
+        struct Slope {
+            float kp;
+            float ki;
+            float kd;
+        };
+        
+        void updateSlopes();
+        
+        Point _points[PID_GAIN_SCHEDULE_SIZE];
+        Slope _slopes[PID_GAIN_SCHEDULE_SIZE];
+        uint8_t _count;
+        uint8_t _segment;
+        Source _source;
+};
@@ -0,0 +1,67 @@
+/**************************************************************************************************
+ * PID_Group - Multi-loop scheduler for PID_Control
+ * Implementation
+ **************************************************************************************************/
+
+#include "PID_Group.h"
+
+PID_Group::PID_Group() {
+    _count = 0;
+}
+
+int PID_Group::add(PID_Control& pid, SensorCallback sensor) {
+    if (_count >= PID_GROUP_MAX_LOOPS) return -1;
+    
+    _loops[_count].pid = &pid;
+    _loops[_count].sensor = sensor;
+    _loops[_count].input = 0.0;
+    return _count++;
+}
+
+void PID_Group::begin() {
+    unsigned long nowMs = PID_Hal::millis();
+    unsigned long nowUs = PID_Hal::micros();
+    
+    // Loop i first fires i/N of its sample time from now
+    for (uint8_t i = 0; i < _count; i++) {
+        PID_Control* pid = _loops[i].pid;
+        unsigned long now = pid->_useMicros ? nowUs : nowMs;
+        unsigned long offset = pid->_sample_time * i / _count;
+        pid->_last_time = now - pid->_sample_time + offset;
+    }
+}
+
+void PID_Group::update() {
+    // One read of each clock per tick, for loops on either time base
+    unsigned long nowMs = PID_Hal::millis();
+    unsigned long nowUs = PID_Hal::micros();
+    
+    for (uint8_t i = 0; i < _count; i++) {
+        Loop& loop = _loops[i];
+        PID_Control* pid = loop.pid;
+        unsigned long now = pid->_useMicros ? nowUs : nowMs;
+        
+        // disable() has already forced a disabled loop's output to zero
+        if (!pid->_enabled) continue;
+        
+        // Skip loops that aren't due without touching their sensor
+        if (now - pid->_last_time < pid->_sample_time) continue;
+        
+        if (loop.sensor) {
+            loop.input = loop.sensor(i);
+        }
+        pid->updateAt(loop.input, now);
+    }
+}
+
+uint8_t PID_Group::size() {
+    return _count;
+}
+
+PID_Control* PID_Group::get(uint8_t id) {
+    return id < _count ? _loops[id].pid : nullptr;
+}
+
+float PID_Group::getInput(uint8_t id) {
+    return id < _count ? _loops[id].input : 0.0;
+}
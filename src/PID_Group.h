@@ -0,0 +1,54 @@
+/**************************************************************************************************
+ * PID_Group - Multi-loop scheduler for PID_Control
+ * 
+ * Runs many PID_Control instances (e.g. heater zones) from a single update() call.
+ * 
+ * Features:
+ * - Reads the clock once per tick for every loop
+ * - Staggers sample phases so loops with the same sample time don't all fire together
+ * - Reads a loop's sensor only when that loop is due
+ * - Loops are addressed by id, including from a single PID_Tune session
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <PID_Control.h>
+
+#ifndef PID_GROUP_MAX_LOOPS
+#define PID_GROUP_MAX_LOOPS 16
+#endif
+
+class PID_Group {
+    public:
+        // Sensor reading callback, given the id of the loop being sampled
+        using SensorCallback = float (*)(uint8_t id);
+        
+        PID_Group();
+        
+        // Add a controller, returns its id or -1 if the group is full
+        int add(PID_Control& pid, SensorCallback sensor);
+        
+        // Spread the loops' sample phases evenly over their sample time - call after adding loops
+        // (enable() restarts a loop's timing, call begin() again to re-stagger)
+        void begin();
+        
+        // Main update function - call this in your loop()
+        void update();
+        
+        uint8_t size();
+        PID_Control* get(uint8_t id);
+        
+        // Last input read for a loop
+        float getInput(uint8_t id);
+        
+    private:
+        struct Loop {
+            PID_Control* pid;
+            SensorCallback sensor;
+            float input;
+        };
+        
+        Loop _loops[PID_GROUP_MAX_LOOPS];
+        uint8_t _count;
+};
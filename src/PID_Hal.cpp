@@ -0,0 +1,32 @@
+/**************************************************************************************************
+ * PID_Hal - Clock and output hooks
+ * Implementation
+ **************************************************************************************************/
+
+#include "PID_Hal.h"
+
+// Wrappers, as some cores declare these as macros or with other argument types
+static unsigned long arduinoMillis() {
+    return millis();
+}
+
+static unsigned long arduinoMicros() {
+    return micros();
+}
+
+static void arduinoOutput(int pin, int value) {
+    analogWrite(pin, value);
+}
+
+PID_Hal::ClockFunction PID_Hal::_millis = arduinoMillis;
+PID_Hal::ClockFunction PID_Hal::_micros = arduinoMicros;
+PID_Hal::OutputFunction PID_Hal::_output = arduinoOutput;
+
+void PID_Hal::setClock(ClockFunction millisFunction, ClockFunction microsFunction) {
+    _millis = millisFunction ? millisFunction : arduinoMillis;
+    _micros = microsFunction ? microsFunction : arduinoMicros;
+}
+
+void PID_Hal::setOutput(OutputFunction outputFunction) {
+    _output = outputFunction ? outputFunction : arduinoOutput;
+}
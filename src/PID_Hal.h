@@ -0,0 +1,53 @@
+/**************************************************************************************************
+ * PID_Hal - Clock and output hooks
+ * 
+ * The controllers read time and write their output pin through these hooks instead of calling
+ * millis()/micros()/analogWrite() directly. By default they forward to the Arduino core; point
+ * them elsewhere to drive the library from a simulated clock, write outputs to a DAC or motor
+ * driver, or run it on a desktop build (see extras/host).
+ * 
+ * pinMode() is still called directly when a controller is constructed with an output pin.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+class PID_Hal {
+    public:
+        using ClockFunction = unsigned long (*)();
+        using OutputFunction = void (*)(int pin, int value);
+        
+        // Replace the clocks (nullptr restores millis()/micros()). Both must keep running
+        // and wrap like their Arduino counterparts.
+        static void setClock(ClockFunction millisFunction, ClockFunction microsFunction);
+        
+        // Replace the output writer (nullptr restores analogWrite())
+        static void setOutput(OutputFunction outputFunction);
+        
+        static unsigned long millis() {
+            return _millis();
+        }
+        
+        static unsigned long micros() {
+            return _micros();
+        }
+        
+        static void output(int pin, int value) {
+            _output(pin, value);
+        }
+        
+        // The hooks in use
+        static ClockFunction getMillisFunction() {
+            return _millis;
+        }
+        
+        static OutputFunction getOutputFunction() {
+            return _output;
+        }
+        
+    private:
+        static ClockFunction _millis;
+        static ClockFunction _micros;
+        static OutputFunction _output;
+};
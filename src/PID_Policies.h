@@ -0,0 +1,216 @@
+/**************************************************************************************************
+ * PID_Policies - Compile-time feature selection for PID_ControlT
+ * 
+ *     PID_ControlT<float, PID_Safety::None, PID_Derivative::OnMeasurement, PID_Output::Sink>
+ * 
+ * A safety check, output path or runtime direction a policy leaves out has no fields in the
+ * controller and no code in update(): the state holders below are empty for it and PID_ControlT
+ * derives from them, so the empty base optimization drops them. PID_Derivative::None only drops
+ * the D computation; the derivative history and gain fields stay. The flags are constant, so the
+ * branches that test them fold away (C++11, no if constexpr needed for the AVR toolchain).
+ * Calling the setter of a feature that was compiled out fails with a static_assert.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <PID_Hal.h>
+
+// Input checks. A custom policy is any struct with these three flags.
+namespace PID_Safety {
+    struct Full {  // NaN, safe value limits and stale data detection (default)
+        static constexpr bool nan = true;
+        static constexpr bool range = true;
+        static constexpr bool stale = true;
+    };
+    struct NaN {   // Only reject NaN readings
+        static constexpr bool nan = true;
+        static constexpr bool range = false;
+        static constexpr bool stale = false;
+    };
+    struct None {
+        static constexpr bool nan = false;
+        static constexpr bool range = false;
+        static constexpr bool stale = false;
+    };
+}
+
+// What the D term differentiates; the signal is subtracted from the output
+namespace PID_Derivative {
+    struct OnMeasurement {  // No kick on setpoint changes (default)
+        static constexpr bool enabled = true;
+        template <typename T> static T signal(T input, T error) { (void)error; return input; }
+    };
+    struct OnError {        // Classic textbook form, d(error)/dt
+        static constexpr bool enabled = true;
+        template <typename T> static T signal(T input, T error) { (void)input; return -error; }
+    };
+    struct None {           // PI controller, Kd is ignored
+        static constexpr bool enabled = false;
+        template <typename T> static T signal(T input, T error) { (void)error; return input; }
+    };
+}
+
+// Where the output goes
+namespace PID_Output {
+    struct Pin {       // PID_Hal::output() (analogWrite) on the constructor's pin (default)
+        static constexpr bool sink = false;
+    };
+    struct Sink {      // setOutputSink(), e.g. a DAC or timer compare register
+        static constexpr bool sink = true;
+    };
+    struct None {      // Nothing written, read getOutput()
+        static constexpr bool sink = false;
+    };
+}
+
+// Controller action
+namespace PID_Direction {
+    struct Runtime {};   // Set by the constructor's polarity argument (default)
+    struct Direct {};    // Output rises when the process value is below the setpoint
+    struct Reverse {};   // Output rises when the process value is above the setpoint
+}
+
+// State holders, one specialization per policy. Names are prefixed as they become members of
+// PID_ControlT.
+
+template <typename T, typename Output>
+struct PID_OutputState;
+
+template <typename T>
+struct PID_OutputState<T, PID_Output::Pin> {
+    int _out_pin;
+    
+    void initOutput(int pin) {
+        _out_pin = pin;
+        if (_out_pin >= 0) {
+            pinMode(_out_pin, OUTPUT);
+            PID_Hal::output(_out_pin, 0);
+        }
+    }
+    void writeOutput(T value) {
+        if (_out_pin >= 0) {
+            PID_Hal::output(_out_pin, (int)value);
+        }
+    }
+};
+
+template <typename T>
+struct PID_OutputState<T, PID_Output::Sink> {
+    using OutputSink = void (*)(T output, void* context);
+    OutputSink _outputSink;
+    void* _outputContext;
+    
+    void initOutput(int) {
+        _outputSink = nullptr;
+        _outputContext = nullptr;
+    }
+    void writeOutput(T value) {
+        if (_outputSink) _outputSink(value, _outputContext);
+    }
+};
+
+template <typename T>
+struct PID_OutputState<T, PID_Output::None> {
+    void initOutput(int) {}
+    void writeOutput(T) {}
+};
+
+template <typename Direction>
+struct PID_DirectionState {
+    bool _polarity;
+    
+    void initDirection(bool polarity) { _polarity = polarity; }
+    bool isDirect() const { return _polarity; }
+};
+
+template <>
+struct PID_DirectionState<PID_Direction::Direct> {
+    void initDirection(bool) {}
+    static constexpr bool isDirect() { return true; }
+};
+
+template <>
+struct PID_DirectionState<PID_Direction::Reverse> {
+    void initDirection(bool) {}
+    static constexpr bool isDirect() { return false; }
+};
+
+// Safe value limits
+template <typename T, bool Enabled>
+struct PID_RangeState {
+    void initRange() {}
+    bool rangeFault(T) { return false; }
+};
+
+template <typename T>
+struct PID_RangeState<T, true> {
+    bool _safeValueEnabled;
+    T _safeMinValue;
+    T _safeMaxValue;
+    
+    void initRange() {
+        _safeValueEnabled = false;
+        _safeMinValue = T(0.0f);
+        _safeMaxValue = T(100.0f);
+    }
+    bool rangeFault(T input) {
+        return _safeValueEnabled && (input < _safeMinValue || input > _safeMaxValue);
+    }
+};
+
+// Stale data detection (only when away from setpoint), compared without dividing:
+// |change| < minRate * elapsed
+template <typename T, bool Enabled>
+struct PID_StaleState {
+    void initStale() {}
+    void restartStale() {}
+    bool staleFault(T, T, unsigned long) { return false; }
+};
+
+template <typename T>
+struct PID_StaleState<T, true> {
+    bool _staleDataEnabled;
+    float _minRateOfChange;
+    T _minChangePerMs;
+    unsigned long _maxStaleTimeMs;
+    unsigned long _lastGoodTime;
+    T _lastGoodValue;
+    
+    void initStale() {
+        _staleDataEnabled = false;
+        _minRateOfChange = 0.0;
+        _minChangePerMs = T(0.0f);
+        _maxStaleTimeMs = 5000;
+        _lastGoodTime = 0;
+        _lastGoodValue = T(0.0f);
+    }
+    void restartStale() { _lastGoodTime = 0; }
+    
+    bool staleFault(T error, T input, unsigned long now) {
+        if (!_staleDataEnabled) return false;
+        
+        T distance = error < T(0.0f) ? -error : error;
+        if (distance > T(0.1f)) {
+            if (_lastGoodTime == 0) {
+                _lastGoodTime = now;
+                _lastGoodValue = input;
+            } else {
+                unsigned long timeDiff = now - _lastGoodTime;
+                T change = input - _lastGoodValue;
+                if (change < T(0.0f)) change = -change;
+                bool changing = change >= _minChangePerMs * (long)timeDiff;
+                if (!changing && timeDiff > _maxStaleTimeMs) {
+                    return true;
+                } else if (changing) {
+                    _lastGoodTime = now;
+                    _lastGoodValue = input;
+                }
+            }
+        } else {
+            _lastGoodTime = now;
+            _lastGoodValue = input;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,281 @@
+/**************************************************************************************************
+ * PID_Sim - Plant simulator and sensor log replay
+ * Implementation
+ **************************************************************************************************/
+
+#include "PID_Sim.h"
+
+PID_SIM_THREAD_LOCAL PID_Sim* PID_Sim::_active = nullptr;
+
+PID_Sim::PID_Sim() {
+    _model = MODEL_FIRST_ORDER;
+    _gain = 1.0;
+    _timeConstant = 1.0;
+    _deadTime = 0.0;
+    _offset = 0.0;
+    _omega2 = 1.0;
+    _twoZetaOmega = 2.0;
+    _stepUs = PID_SIM_STEP;
+    _replay = nullptr;
+    _replayCount = 0;
+    _replayIntervalUs = 0;
+    _replayLoop = false;
+    _pid = nullptr;
+    _input = 0.0;
+    _noise = 0.0;
+    _seed = 1;
+    _micros = 0;
+    _millis = 0;
+    _microsRemainder = 0;
+    _lastReal = 0;
+    _timeScale = 1.0;
+    configure();
+    reset();
+}
+
+void PID_Sim::setFirstOrder(float gain, float timeConstant, float deadTime) {
+    _model = MODEL_FIRST_ORDER;
+    _gain = gain;
+    _timeConstant = timeConstant > 0.0 ? timeConstant : 0.0;
+    _deadTime = deadTime > 0.0 ? deadTime : 0.0;
+    configure();
+    reset();
+}
+
+void PID_Sim::setSecondOrder(float gain, float naturalFrequency, float damping, float deadTime) {
+    _model = MODEL_SECOND_ORDER;
+    _gain = gain;
+    _omega2 = naturalFrequency * naturalFrequency;
+    _twoZetaOmega = 2.0 * damping * naturalFrequency;
+    _deadTime = deadTime > 0.0 ? deadTime : 0.0;
+    configure();
+    reset();
+}
+
+void PID_Sim::setReplay(const float* values, size_t count, unsigned long intervalMs, bool loop) {
+    _model = MODEL_REPLAY;
+    _replay = values;
+    _replayCount = values ? count : 0;
+    _replayIntervalUs = (intervalMs > 0 ? intervalMs : 1) * 1000UL;
+    _replayLoop = loop;
+    reset();
+}
+
+void PID_Sim::setOffset(float offset) {
+    _offset = offset;
+    reset();
+}
+
+void PID_Sim::setNoise(float amplitude, uint32_t seed) {
+    _noise = fabs(amplitude);
+    _seed = seed ? seed : 1;  // xorshift sticks at 0
+}
+
+void PID_Sim::setStep(unsigned long stepUs) {
+    _stepUs = stepUs > 0 ? stepUs : 1;
+    configure();
+    reset();
+}
+
+unsigned long PID_Sim::getStep() {
+    return _stepUs;
+}
+
+void PID_Sim::attach(PID_Control& pid) {
+    _pid = &pid;
+}
+
+void PID_Sim::detach() {
+    _pid = nullptr;
+}
+
+void PID_Sim::setInput(float input) {
+    _input = input;
+}
+
+void PID_Sim::reset() {
+    _value = _offset;
+    _rate = 0.0;
+    _pendingUs = 0;
+    
+    // The delay line starts as if the input had been what it is now for a while
+    _delayed = currentInput();
+    for (uint16_t i = 0; i < _delayLength; i++) _delay[i] = _delayed;
+    _delayIndex = 0;
+    _delayCount = 0;
+    
+    _replayIndex = 0;
+    _replayPhaseUs = 0;
+    if (_model == MODEL_REPLAY) _value = _replayCount > 0 ? _replay[0] : _offset;
+}
+
+void PID_Sim::begin(bool virtualClock) {
+    _active = this;
+    
+    // Hooks are only written when they change, so simulators on several threads (host build)
+    // can begin() once the first one has installed them
+    if (virtualClock && PID_Hal::getMillisFunction() != activeMillis) {
+        PID_Hal::setClock(activeMillis, activeMicros);
+    }
+    if (PID_Hal::getOutputFunction() != mutedOutput) PID_Hal::setOutput(mutedOutput);
+    _lastReal = micros();
+}
+
+void PID_Sim::end() {
+    if (_active != this) return;
+    PID_Hal::setClock(nullptr, nullptr);
+    PID_Hal::setOutput(nullptr);
+    _active = nullptr;
+}
+
+void PID_Sim::step(unsigned long dtUs) {
+    // Both clocks count from the same microseconds, so they stay in step when they wrap
+    _micros += dtUs;
+    _microsRemainder += dtUs;
+    _millis += _microsRemainder / 1000;
+    _microsRemainder %= 1000;
+    
+    _pendingUs += dtUs;
+    while (_pendingUs >= _stepUs) {
+        integrate();
+        _pendingUs -= _stepUs;
+    }
+}
+
+void PID_Sim::update() {
+    unsigned long now = micros();
+    unsigned long elapsed = now - _lastReal;
+    _lastReal = now;
+    step(_timeScale == 1.0 ? elapsed : (unsigned long)(elapsed * _timeScale));
+}
+
+void PID_Sim::setTimeScale(float scale) {
+    _timeScale = scale > 0.0 ? scale : 1.0;
+}
+
+float PID_Sim::run(PID_Control& pid, unsigned long durationMs) {
+    // The controller has to see the virtual clock
+    bool started = _active != this;
+    if (started) begin();
+    PID_Control* attached = _pid;
+    _pid = &pid;
+    
+    unsigned long steps = (unsigned long)((unsigned long long)durationMs * 1000 / _stepUs);
+    float iae = 0.0;
+    for (unsigned long i = 0; i < steps; i++) {
+        step(_stepUs);
+        float pv = read();
+        pid.update(pv);
+        iae += fabs(pid.getSetpoint() - pv);
+    }
+    
+    _pid = attached;
+    if (started) end();
+    return iae * _dt;
+}
+
+float PID_Sim::read() {
+    if (_noise == 0.0) return _value;
+    
+    // xorshift32: cheap, and the same sequence for the same seed on every build
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    float unit = (_seed >> 8) * (1.0f / 16777216.0f);
+    return _value + (2.0f * unit - 1.0f) * _noise;
+}
+
+float PID_Sim::getValue() {
+    return _value;
+}
+
+float PID_Sim::getInput() {
+    return currentInput();
+}
+
+PID_Sim::Model PID_Sim::getModel() {
+    return _model;
+}
+
+float PID_Sim::getDeadTime() {
+    return _delayLength * (float)_delayStride * _dt;
+}
+
+unsigned long PID_Sim::getMillis() {
+    return _millis;
+}
+
+unsigned long PID_Sim::getMicros() {
+    return _micros;
+}
+
+// Step-dependent constants; the exponential is taken here so integrate() doesn't
+void PID_Sim::configure() {
+    _dt = _stepUs * 1e-6f;
+    _alpha = _timeConstant > 0.0 ? 1.0f - expf(-_dt / _timeConstant) : 1.0f;
+    
+    // Dead time in model steps, in at most PID_SIM_DELAY_SIZE entries
+    unsigned long steps = (unsigned long)(_deadTime / _dt + 0.5f);
+    _delayStride = steps > PID_SIM_DELAY_SIZE ? (steps + PID_SIM_DELAY_SIZE - 1) / PID_SIM_DELAY_SIZE : 1;
+    _delayLength = (uint16_t)((steps + _delayStride / 2) / _delayStride);
+    if (_delayLength > PID_SIM_DELAY_SIZE) _delayLength = PID_SIM_DELAY_SIZE;
+}
+
+void PID_Sim::integrate() {
+    if (_model == MODEL_REPLAY) {
+        if (_replayCount == 0) return;
+        _replayPhaseUs += _stepUs;
+        while (_replayPhaseUs >= _replayIntervalUs) {
+            _replayPhaseUs -= _replayIntervalUs;
+            if (_replayIndex + 1 < _replayCount) {
+                _replayIndex++;
+            } else if (_replayLoop) {
+                _replayIndex = 0;
+            } else {
+                _replayPhaseUs = 0;
+                break;
+            }
+        }
+        size_t next = _replayIndex + 1 < _replayCount ? _replayIndex + 1 : (_replayLoop ? 0 : _replayIndex);
+        float t = (float)_replayPhaseUs / _replayIntervalUs;
+        _value = _replay[_replayIndex] + (_replay[next] - _replay[_replayIndex]) * t;
+        return;
+    }
+    
+    // Dead time: the input taken _delayLength entries ago
+    float input = currentInput();
+    if (_delayLength == 0) {
+        _delayed = input;
+    } else if (++_delayCount >= _delayStride) {
+        _delayCount = 0;
+        _delayed = _delay[_delayIndex];
+        _delay[_delayIndex] = input;
+        _delayIndex = _delayIndex + 1 < _delayLength ? _delayIndex + 1 : 0;
+    }
+    
+    float target = _offset + _gain * _delayed;
+    if (_model == MODEL_FIRST_ORDER) {
+        _value += (target - _value) * _alpha;
+    } else {
+        // Semi-implicit Euler, stable while naturalFrequency * step stays well below 1
+        _rate += (_omega2 * (target - _value) - _twoZetaOmega * _rate) * _dt;
+        _value += _rate * _dt;
+    }
+}
+
+float PID_Sim::currentInput() {
+    return _pid ? _pid->getOutput() : _input;
+}
+
+unsigned long PID_Sim::activeMillis() {
+    return _active ? _active->_millis : 0;
+}
+
+unsigned long PID_Sim::activeMicros() {
+    return _active ? _active->_micros : 0;
+}
+
+void PID_Sim::mutedOutput(int pin, int value) {
+    (void)pin;
+    (void)value;
+}
@@ -0,0 +1,163 @@
+/**************************************************************************************************
+ * PID_Sim - Plant simulator and sensor log replay
+ * 
+ * A deterministic process model to tune against instead of the real plant: first-order plus
+ * dead time (FOPDT), second-order plus dead time (SOPDT), or the replay of a logged sensor
+ * trace. The plant is driven by a PID_Control's output and read like a sensor:
+ * 
+ *     PID_Sim sim;
+ *     sim.setFirstOrder(2.0, 30.0, 5.0);  // Gain, time constant (s), dead time (s)
+ *     sim.setOffset(20.0);                // pv with no output (ambient)
+ *     sim.attach(pid);
+ *     sim.begin();                        // Virtual clock, outputs muted
+ *     tuner.setSensorCallback([] { return sim.read(); });
+ * 
+ * begin() points PID_Hal at the simulator's virtual clock and mutes output writes, so nothing
+ * reaches the real actuator. The clock moves with step(), with update() (real time, scaled by
+ * setTimeScale()) or with run(), which closes the loop as fast as the CPU allows. Runs are
+ * repeatable: the models use fixed steps and the noise a seeded generator.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <PID_Control.h>
+#include <PID_Hal.h>
+
+// Entries of the dead time delay line; longer dead times are sampled more coarsely
+#ifndef PID_SIM_DELAY_SIZE
+#if defined(__AVR__)
+#define PID_SIM_DELAY_SIZE 32
+#else
+#define PID_SIM_DELAY_SIZE 256
+#endif
+#endif
+
+// Default model step in microseconds
+#ifndef PID_SIM_STEP
+#define PID_SIM_STEP 1000
+#endif
+
+// Storage of the simulator the virtual clock reads; thread_local lets each thread of a host
+// program run its own (extras/host sets it)
+#ifndef PID_SIM_THREAD_LOCAL
+#define PID_SIM_THREAD_LOCAL
+#endif
+
+class PID_Sim {
+    public:
+        enum Model {
+            MODEL_FIRST_ORDER,
+            MODEL_SECOND_ORDER,
+            MODEL_REPLAY
+        };
+        
+        PID_Sim();
+        
+        // pv = offset + gain * output, reached through a lag of timeConstant seconds after
+        // deadTime seconds
+        void setFirstOrder(float gain, float timeConstant, float deadTime = 0.0);
+        
+        // Same steady state, reached by a second-order response (naturalFrequency in rad/s,
+        // damping below 1 overshoots)
+        void setSecondOrder(float gain, float naturalFrequency, float damping, float deadTime = 0.0);
+        
+        // Play a logged pv trace, one value per intervalMs, linearly interpolated. At the end it
+        // starts over when loop is set, or holds the last value. The output is ignored.
+        void setReplay(const float* values, size_t count, unsigned long intervalMs, bool loop = false);
+        
+        void setOffset(float offset);
+        
+        // Uniform noise of +-amplitude on read(), from a generator seeded with seed
+        void setNoise(float amplitude, uint32_t seed = 1);
+        
+        // Model step, also the resolution of step()
+        void setStep(unsigned long stepUs);
+        unsigned long getStep();
+        
+        // Plant input: the controller's output, or a fixed value when no controller is attached
+        void attach(PID_Control& pid);
+        void detach();
+        void setInput(float input);
+        
+        // Back to the model's rest state (pv at the offset, replay at its start)
+        void reset();
+        
+        // Take over the library's clock and outputs (virtualClock false keeps the real clock)
+        void begin(bool virtualClock = true);
+        void end();
+        
+        // Advance the clock and the plant by dtUs
+        void step(unsigned long dtUs);
+        
+        // Advance by the real time since the last call times the time scale - call this in
+        // your loop() to tune against the model live
+        void update();
+        void setTimeScale(float scale);
+        
+        // Close the loop around pid for durationMs of virtual time as fast as possible, updating
+        // it every model step (begin() is implied). Returns the integral of |setpoint - pv| over
+        // the run.
+        float run(PID_Control& pid, unsigned long durationMs);
+        
+        float read();       // pv, with noise
+        float getValue();   // pv without noise
+        float getInput();
+        Model getModel();
+        float getDeadTime();  // As modelled, in seconds: a multiple of the delay line step
+        
+        // The virtual clock
+        unsigned long getMillis();
+        unsigned long getMicros();
+        
+    private:
+        void configure();
+        void integrate();
+        float currentInput();
+        static unsigned long activeMillis();
+        static unsigned long activeMicros();
+        static void mutedOutput(int pin, int value);
+        
+        static PID_SIM_THREAD_LOCAL PID_Sim* _active;  // Simulator PID_Hal's clock reads
+        
+        Model _model;
+        float _gain;
+        float _timeConstant;
+        float _deadTime;
+        float _offset;
+        float _value;
+        float _rate;    // dpv/dt of the second-order model
+        float _alpha;   // First-order step response per step, 1 - exp(-dt / tau)
+        float _omega2;  // naturalFrequency^2
+        float _twoZetaOmega;
+        unsigned long _stepUs;
+        float _dt;
+        unsigned long _pendingUs;  // Of step() not yet integrated
+        
+        // Dead time: inputs delayed by _delayLength entries taken every _delayStride steps
+        float _delay[PID_SIM_DELAY_SIZE];
+        uint16_t _delayLength;
+        uint16_t _delayIndex;
+        uint16_t _delayStride;
+        uint16_t _delayCount;
+        float _delayed;
+        
+        const float* _replay;
+        size_t _replayCount;
+        unsigned long _replayIntervalUs;
+        size_t _replayIndex;
+        unsigned long _replayPhaseUs;  // Time since _replay[_replayIndex]
+        bool _replayLoop;
+        
+        PID_Control* _pid;
+        float _input;
+        
+        float _noise;
+        uint32_t _seed;
+        
+        unsigned long _micros;
+        unsigned long _millis;
+        unsigned long _microsRemainder;
+        unsigned long _lastReal;
+        float _timeScale;
+};
@@ -0,0 +1,120 @@
+/**************************************************************************************************
+ * PID_Spsc - Lock-free single-producer / single-consumer hand-over
+ * 
+ * PID_SpscSlot<T> passes the latest value of T from one context (ISR, task or loop()) to another
+ * without disabling interrupts. The writer never waits; a reader that catches the writer mid-
+ * update just gets "nothing new" and tries again next time, so it is safe to read from an ISR.
+ * PID_SpscQueue<T, N> is a bounded FIFO for values that must all arrive (commands, samples);
+ * push() fails instead of waiting when it is full.
+ * Header-only.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+// Orders the slot's sequence counter against the data on multi-core parts. The counter must be
+// read and written in one access, so 8-bit AVR uses a single byte.
+#if defined(__AVR__)
+#define PID_SPSC_BARRIER() __asm__ __volatile__("" ::: "memory")
+typedef uint8_t pid_spsc_seq_t;
+#else
+#define PID_SPSC_BARRIER() __sync_synchronize()
+typedef uint32_t pid_spsc_seq_t;
+#endif
+
+template <typename T>
+class PID_SpscSlot {
+    public:
+        PID_SpscSlot() : _sequence(0), _lastRead(0) {}
+        
+        // Producer: publish a new value
+        void write(const T& value) {
+            pid_spsc_seq_t seq = _sequence;
+            _sequence = (pid_spsc_seq_t)(seq + 1);  // Odd while writing
+            PID_SPSC_BARRIER();
+            copy(_value, value);
+            PID_SPSC_BARRIER();
+            _sequence = (pid_spsc_seq_t)(seq + 2);
+        }
+        
+        // Consumer: copy out the value if a new one was published since the last read.
+        // Returns false if there is nothing new or the producer is writing right now.
+        bool read(T& value) {
+            pid_spsc_seq_t before = _sequence;
+            if ((before & 1) || before == _lastRead) return false;
+            PID_SPSC_BARRIER();
+            copy(value, _value);
+            PID_SPSC_BARRIER();
+            if (_sequence != before) return false;
+            _lastRead = before;
+            return true;
+        }
+        
+        // Consumer: true if a value was published that hasn't been read yet
+        bool available() {
+            pid_spsc_seq_t seq = _sequence;
+            return !(seq & 1) && seq != _lastRead;
+        }
+        
+    private:
+        // Byte copy through volatile so the compiler can't cache the shared value
+        static void copy(volatile T& dst, const T& src) {
+            const uint8_t* s = reinterpret_cast<const uint8_t*>(&src);
+            volatile uint8_t* d = reinterpret_cast<volatile uint8_t*>(&dst);
+            for (size_t i = 0; i < sizeof(T); i++) d[i] = s[i];
+        }
+        
+        static void copy(T& dst, const volatile T& src) {
+            const volatile uint8_t* s = reinterpret_cast<const volatile uint8_t*>(&src);
+            uint8_t* d = reinterpret_cast<uint8_t*>(&dst);
+            for (size_t i = 0; i < sizeof(T); i++) d[i] = s[i];
+        }
+        
+        volatile T _value;
+        volatile pid_spsc_seq_t _sequence;
+        pid_spsc_seq_t _lastRead;
+};
+
+template <typename T, uint8_t N>
+class PID_SpscQueue {
+    static_assert(N >= 2, "PID_SpscQueue needs room for at least one element");
+    
+    public:
+        PID_SpscQueue() : _head(0), _tail(0) {}
+        
+        // Producer: append a value, false if the queue is full
+        bool push(const T& value) {
+            uint8_t head = _head;
+            uint8_t next = advance(head);
+            if (next == _tail) return false;
+            _items[head] = value;
+            PID_SPSC_BARRIER();
+            _head = next;
+            return true;
+        }
+        
+        // Consumer: take the oldest value, false if the queue is empty
+        bool pop(T& value) {
+            uint8_t tail = _tail;
+            if (tail == _head) return false;
+            PID_SPSC_BARRIER();
+            value = _items[tail];
+            PID_SPSC_BARRIER();
+            _tail = advance(tail);
+            return true;
+        }
+        
+        bool empty() {
+            return _tail == _head;
+        }
+        
+    private:
+        static uint8_t advance(uint8_t index) {
+            return index + 1 == N ? 0 : index + 1;
+        }
+        
+        T _items[N];  // One element is kept free to tell full from empty
+        volatile uint8_t _head;  // Written by the producer only
+        volatile uint8_t _tail;  // Written by the consumer only
+};
@@ -0,0 +1,307 @@
+/**************************************************************************************************
+ * PID_Storage - Persistent controller parameters
+ * Implementation
+ **************************************************************************************************/
+
+#include "PID_Storage.h"
+#include <PID_Crc.h>
+
+#if PID_STORAGE_HAS_EEPROM
+#include <EEPROM.h>
+
+static uint8_t eepromRead(uint16_t address) {
+    return EEPROM.read(address);
+}
+
+#if defined(ARDUINO_ARCH_AVR)
+#include <avr/eeprom.h>
+
+// update() skips bytes that already hold the value
+static void eepromWrite(uint16_t address, uint8_t value) {
+    EEPROM.update(address, value);
+}
+
+static bool eepromReady() {
+    return eeprom_is_ready();
+}
+#define PID_EEPROM_READY eepromReady
+#define PID_EEPROM_COMMIT nullptr
+#else
+// Emulated in flash: writes go to a RAM copy, commit() programs the flash
+static void eepromWrite(uint16_t address, uint8_t value) {
+    EEPROM.write(address, value);
+}
+
+static void eepromCommit() {
+    EEPROM.commit();
+}
+#define PID_EEPROM_READY nullptr
+#define PID_EEPROM_COMMIT eepromCommit
+#endif
+#endif
+
+#define PID_STORAGE_MAGIC 0xB5
+
+PID_Storage::PID_Storage(uint16_t address, uint8_t slots) {
+#if PID_STORAGE_HAS_EEPROM
+    _read = eepromRead;
+    _write = eepromWrite;
+    _ready = PID_EEPROM_READY;
+    _commit = PID_EEPROM_COMMIT;
+#else
+    _read = nullptr;
+    _write = nullptr;
+    _ready = nullptr;
+    _commit = nullptr;
+#endif
+    _address = address;
+    _slots = slots > 0 ? (slots <= 32 ? slots : 32) : 1;  // begin() tracks slots in a 32-bit mask
+    memset(&_image, 0, sizeof(_image));
+    _valid = false;
+    _slot = 0;
+    _busy = false;
+    _writeIndex = 0;
+    _saves = 0;
+    _writes = 0;
+}
+
+void PID_Storage::setBackend(ReadFunction read, WriteFunction write, ReadyFunction ready,
+                             CommitFunction commit) {
+    _read = read;
+    _write = write;
+    _ready = ready;
+    _commit = commit;
+}
+
+bool PID_Storage::begin() {
+    if (!_read || !_write) return false;
+
+#if PID_STORAGE_HAS_EEPROM && !defined(ARDUINO_ARCH_AVR)
+    if (_read == eepromRead) {
+        EEPROM.begin(_address + (uint32_t)_slots * slotSize());
+    }
+#endif
+
+    // Newest header first; a slot whose CRC fails is skipped for the next newest
+    _valid = false;
+    uint32_t rejected = 0;
+    while (true) {
+        bool found = false;
+        uint8_t best = 0;
+        uint16_t bestSequence = 0;
+        for (uint8_t slot = 0; slot < _slots; slot++) {
+            if (rejected & (1UL << slot)) continue;
+            
+            Header header;
+            uint8_t* bytes = reinterpret_cast<uint8_t*>(&header);
+            uint16_t address = slotAddress(slot);
+            for (uint16_t i = 0; i < sizeof(header); i++) bytes[i] = _read(address + i);
+            
+            if (header.magic != PID_STORAGE_MAGIC || header.version != PID_STORAGE_VERSION ||
+                header.length != sizeof(PID_StoredParams)) {
+                continue;
+            }
+            // Sequence numbers wrap, so compare them by difference
+            if (!found || (int16_t)(header.sequence - bestSequence) > 0) {
+                found = true;
+                best = slot;
+                bestSequence = header.sequence;
+            }
+        }
+        if (!found) break;
+        
+        readSlot(best, _image);
+        if (checkSlot(_image)) {
+            _valid = true;
+            _slot = best;
+            break;
+        }
+        rejected |= 1UL << best;
+    }
+    
+    if (!_valid) {
+        memset(&_image, 0, sizeof(_image));
+        _slot = _slots - 1;  // The first write goes to slot 0
+    }
+    return true;
+}
+
+bool PID_Storage::restore(PID_Control& pid) {
+    PID_StoredParams params;
+    if (!read(params)) return false;
+    apply(pid, params);
+    return true;
+}
+
+bool PID_Storage::read(PID_StoredParams& params) {
+    if (!_valid || _busy) return false;
+    params = _image.params;
+    return true;
+}
+
+bool PID_Storage::save(PID_Control& pid) {
+    PID_StoredParams params;
+    capture(pid, params);
+    return write(params);
+}
+
+bool PID_Storage::write(const PID_StoredParams& params) {
+    if (!_write || _busy) return false;
+    
+    if (_valid && memcmp(&params, &_image.params, sizeof(params)) == 0) {
+        _saves++;
+        return false;
+    }
+    
+    _slot = (_slot + 1) % _slots;
+    _image.params = params;
+    _image.header.magic = PID_STORAGE_MAGIC;
+    _image.header.version = PID_STORAGE_VERSION;
+    _image.header.sequence = _valid ? _image.header.sequence + 1 : 0;
+    _image.header.length = sizeof(PID_StoredParams);
+    _image.header.crc = slotCrc(_image);
+    _valid = false;  // Until the last byte is written
+    
+    _writeIndex = 0;
+    _busy = true;
+    update();
+    return true;
+}
+
+bool PID_Storage::update() {
+    if (!_busy) return false;
+    
+    // Params first, then the header with the CRC as the very last bytes
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&_image);
+    uint16_t address = slotAddress(_slot);
+    while (_writeIndex < sizeof(Slot)) {
+        if (_ready && !_ready()) return true;
+        
+        uint16_t offset = _writeIndex < sizeof(PID_StoredParams)
+                              ? sizeof(Header) + _writeIndex
+                              : _writeIndex - sizeof(PID_StoredParams);
+        _write(address + offset, bytes[offset]);
+        _writeIndex++;
+    }
+    
+    if (_commit) _commit();
+    _valid = true;
+    _writes++;
+    _saves++;
+    PID_SPSC_BARRIER();
+    _busy = false;
+    return false;
+}
+
+bool PID_Storage::isBusy() {
+    return _busy;
+}
+
+void PID_Storage::erase() {
+    if (!_write || _busy) return;
+    for (uint8_t slot = 0; slot < _slots; slot++) {
+        _write(slotAddress(slot), 0xFF);
+    }
+    if (_commit) _commit();
+    memset(&_image, 0, sizeof(_image));
+    _valid = false;
+    _slot = _slots - 1;
+}
+
+bool PID_Storage::isValid() {
+    return _valid;
+}
+
+uint16_t PID_Storage::getSequence() {
+    return _image.header.sequence;
+}
+
+unsigned long PID_Storage::getSaves() {
+    return _saves;
+}
+
+unsigned long PID_Storage::getWrites() {
+    return _writes;
+}
+
+uint8_t PID_Storage::slots() {
+    return _slots;
+}
+
+uint16_t PID_Storage::slotSize() {
+    return sizeof(Slot);
+}
+
+void PID_Storage::capture(PID_Control& pid, PID_StoredParams& params) {
+    // Zeroed first so unused schedule points and padding compare equal
+    memset(&params, 0, sizeof(params));
+    params.kp = pid._Kp;
+    params.ki = pid._Ki;
+    params.kd = pid._Kd;
+    params.setpoint = pid._targetSetpoint;
+    params.outputMin = pid._output_min;
+    params.outputMax = pid._output_max;
+    params.integralMin = pid._integral_min;
+    params.integralMax = pid._integral_max;
+    params.sampleTime = pid._sample_time;
+    params.micros = pid._useMicros;
+    
+    if (PID_GainSchedule* schedule = pid._schedule) {
+        params.scheduleSource = schedule->getSource();
+        params.schedulePoints = schedule->size();
+        for (uint8_t i = 0; i < params.schedulePoints; i++) {
+            params.schedule[i] = schedule->getPoint(i);
+        }
+    }
+}
+
+void PID_Storage::apply(PID_Control& pid, const PID_StoredParams& params) {
+    if (params.micros) {
+        pid.setSampleTimeUs(params.sampleTime);
+    } else {
+        pid.setSampleTime(params.sampleTime);
+    }
+    pid.setOutputLimits(params.outputMin, params.outputMax);
+    pid.setIntegralLimits(params.integralMin, params.integralMax);
+    pid.setPID(params.kp, params.ki, params.kd);
+    pid.setpoint(params.setpoint);
+    
+    // A stored table replaces the attached one; a blob saved without one leaves it alone
+    PID_GainSchedule* schedule = pid._schedule;
+    if (schedule && params.schedulePoints > 0) {
+        schedule->clear();
+        schedule->setSource((PID_GainSchedule::Source)params.scheduleSource);
+        uint8_t count = params.schedulePoints;
+        if (count > PID_GAIN_SCHEDULE_SIZE) count = PID_GAIN_SCHEDULE_SIZE;
+        for (uint8_t i = 0; i < count; i++) {
+            const PID_GainSchedule::Point& p = params.schedule[i];
+            schedule->addPoint(p.x, p.kp, p.ki, p.kd);
+        }
+    }
+}
+
+uint16_t PID_Storage::slotAddress(uint8_t slot) {
+    return _address + slot * sizeof(Slot);
+}
+
+void PID_Storage::readSlot(uint8_t slot, Slot& image) {
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(&image);
+    uint16_t address = slotAddress(slot);
+    for (uint16_t i = 0; i < sizeof(Slot); i++) bytes[i] = _read(address + i);
+}
+
+bool PID_Storage::checkSlot(const Slot& image) {
+    return image.header.magic == PID_STORAGE_MAGIC &&
+           image.header.version == PID_STORAGE_VERSION &&
+           image.header.length == sizeof(PID_StoredParams) &&
+           image.header.crc == slotCrc(image);
+}
+
+uint16_t PID_Storage::slotCrc(const Slot& image) {
+    const uint8_t* header = reinterpret_cast<const uint8_t*>(&image.header);
+    const uint8_t* params = reinterpret_cast<const uint8_t*>(&image.params);
+    uint16_t crc = PID_CRC16_INIT;
+    for (uint8_t i = 0; i < offsetof(Header, crc); i++) crc = pidCrc16Update(crc, header[i]);
+    for (uint16_t i = 0; i < sizeof(PID_StoredParams); i++) crc = pidCrc16Update(crc, params[i]);
+    return crc;
+}
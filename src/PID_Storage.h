@@ -0,0 +1,144 @@
+/**************************************************************************************************
+ * PID_Storage - Persistent controller parameters
+ * 
+ * Saves a PID_Control's gains, setpoint, limits, sample time and gain schedule as one versioned,
+ * CRC-checked blob, and restores them at boot with a single read:
+ * 
+ *     PID_Storage storage;             // EEPROM from address 0
+ *     storage.begin();
+ *     pid.begin(2.0, 0.5, 0.1, 25.0);  // Defaults for a blank or outdated EEPROM
+ *     storage.restore(pid);
+ * 
+ * The region holds several slots that are written in turn, each stamped with a sequence
+ * number; restore() picks the newest slot whose CRC checks out. That spreads the wear, and a
+ * write cut short by a power loss leaves the previous slot in place. save() only writes when
+ * something changed since the last save or restore.
+ * 
+ * Writes are non-blocking: update() writes bytes as the EEPROM is ready for them (one per
+ * ~3.3ms on AVR) and the header and CRC go last. Where EEPROM is emulated in flash (ESP32,
+ * ESP8266, RP2040) the bytes go to RAM and the final commit blocks for the flash write.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <PID_Control.h>
+#include <PID_GainSchedule.h>
+#include <PID_Spsc.h>
+#include <stddef.h>
+
+// Built-in EEPROM backend, on cores with an EEPROM library. Elsewhere (or with 0) give the
+// backend functions to setBackend().
+#ifndef PID_STORAGE_HAS_EEPROM
+#if defined(ARDUINO_ARCH_AVR) || defined(ESP32) || defined(ESP8266) || defined(ARDUINO_ARCH_RP2040)
+#define PID_STORAGE_HAS_EEPROM 1
+#else
+#define PID_STORAGE_HAS_EEPROM 0
+#endif
+#endif
+
+// Slots written in turn, so each byte is written once per this many saves
+#ifndef PID_STORAGE_SLOTS
+#define PID_STORAGE_SLOTS 4
+#endif
+
+// Blob layout version, bump when PID_StoredParams changes
+#define PID_STORAGE_VERSION 1
+
+// What is stored for a controller
+struct PID_StoredParams {
+    float kp;
+    float ki;
+    float kd;
+    float setpoint;
+    float outputMin;
+    float outputMax;
+    float integralMin;
+    float integralMax;
+    uint32_t sampleTime;     // ms, or us when micros is set
+    uint8_t micros;
+    uint8_t scheduleSource;
+    uint8_t schedulePoints;  // 0 without a gain schedule
+    uint8_t reserved;
+    PID_GainSchedule::Point schedule[PID_GAIN_SCHEDULE_SIZE];
+};
+
+class PID_Storage {
+    public:
+        using ReadFunction = uint8_t (*)(uint16_t address);
+        using WriteFunction = void (*)(uint16_t address, uint8_t value);
+        using ReadyFunction = bool (*)();  // Can the next byte be written without waiting
+        using CommitFunction = void (*)();
+        
+        // Region of slots() * slotSize() bytes from address
+        PID_Storage(uint16_t address = 0, uint8_t slots = PID_STORAGE_SLOTS);
+        
+        // Own byte backend (FRAM, external EEPROM, a flash page...); nullptr for ready or
+        // commit when not needed. Call before begin().
+        void setBackend(ReadFunction read, WriteFunction write, ReadyFunction ready = nullptr,
+                        CommitFunction commit = nullptr);
+        
+        // Starts the backend and finds the newest valid slot. False without a backend.
+        bool begin();
+        
+        // Load the newest valid blob into the controller (and its attached gain schedule).
+        // False, leaving the controller as it is, when nothing valid is stored.
+        bool restore(PID_Control& pid);
+        bool read(PID_StoredParams& params);
+        
+        // Start writing the controller's parameters if they differ from the stored ones.
+        // Returns true if a write was started; false if unchanged, busy or without a backend.
+        bool save(PID_Control& pid);
+        bool write(const PID_StoredParams& params);
+        
+        // Progress a pending write - call this in your loop(). Returns true while writing.
+        bool update();
+        bool isBusy();
+        
+        // Forget the stored blob (the slots' headers are cleared)
+        void erase();
+        
+        bool isValid();          // A valid blob was found or written
+        uint16_t getSequence();  // Of the newest blob
+        unsigned long getSaves();   // save()/write() calls completed, written or not
+        unsigned long getWrites();  // Blobs actually written
+        uint8_t slots();
+        static uint16_t slotSize();
+        
+        static void capture(PID_Control& pid, PID_StoredParams& params);
+        static void apply(PID_Control& pid, const PID_StoredParams& params);
+        
+    private:
+        struct Header {
+            uint8_t magic;
+            uint8_t version;
+            uint16_t sequence;
+            uint16_t length;
+            uint16_t crc;  // Over the header up to here and the params
+        };
+        
+        struct Slot {
+            Header header;
+            PID_StoredParams params;
+        };
+        
+        uint16_t slotAddress(uint8_t slot);
+        void readSlot(uint8_t slot, Slot& image);
+        static bool checkSlot(const Slot& image);
+        static uint16_t slotCrc(const Slot& image);
+        
+        ReadFunction _read;
+        WriteFunction _write;
+        ReadyFunction _ready;
+        CommitFunction _commit;
+        uint16_t _address;
+        uint8_t _slots;
+        
+        Slot _image;           // Newest blob, and the one being written
+        bool _valid;
+        uint8_t _slot;         // Where _image is (or goes)
+        volatile bool _busy;
+        uint16_t _writeIndex;  // Next byte of a pending write, in write order
+        volatile unsigned long _saves;
+        volatile unsigned long _writes;
+};
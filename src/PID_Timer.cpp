@@ -0,0 +1,237 @@
+/**************************************************************************************************
+ * PID_Timer - Hardware-timer driven PID_Control updates
+ * Implementation
+ **************************************************************************************************/
+
+#define PID_TIMER_IMPLEMENTATION
+#include "PID_Timer.h"
+
+PID_Timer* volatile PID_Timer::_active = nullptr;
+
+PID_Timer::PID_Timer(PID_Control& pid) : _pid(pid) {
+    _sensor = nullptr;
+    _command.setpoint = 0.0;
+    _command.Kp = 0.0;
+    _command.Ki = 0.0;
+    _command.Kd = 0.0;
+    _command.gainsVersion = 0;
+    _appliedGains = 0;
+    _running = false;
+    _busy = false;
+    _overruns = 0;
+}
+
+bool PID_Timer::begin(SensorCallback sensor) {
+    if (_active || !sensor) return false;
+    
+    _sensor = sensor;
+    _command.setpoint = _pid.getSetpoint();
+    _command.Kp = _pid.getKp();
+    _command.Ki = _pid.getKi();
+    _command.Kd = _pid.getKd();
+    _appliedGains = _command.gainsVersion;
+    _overruns = 0;
+    
+    _active = this;
+    if (!startHardware(_pid.getSampleTimeUs())) {
+        _active = nullptr;
+        return false;
+    }
+    _running = true;
+    return true;
+}
+
+void PID_Timer::end() {
+    if (!_running) return;
+    stopHardware();
+    _running = false;
+    _active = nullptr;
+}
+
+bool PID_Timer::isRunning() {
+    return _running;
+}
+
+void PID_Timer::setpoint(float setpoint) {
+    _command.setpoint = setpoint;
+    _commands.write(_command);
+}
+
+void PID_Timer::setPID(float Kp, float Ki, float Kd) {
+    _command.Kp = Kp;
+    _command.Ki = Ki;
+    _command.Kd = Kd;
+    _command.gainsVersion++;
+    _commands.write(_command);
+}
+
+bool PID_Timer::read(Sample& sample) {
+    return _samples.read(sample);
+}
+
+unsigned long PID_Timer::getOverruns() {
+    return _overruns;
+}
+
+void PID_Timer::isr(unsigned long missed) {
+    PID_Timer* timer = _active;
+    if (!timer) return;
+    timer->_overruns += missed;
+    timer->tick();
+}
+
+void PID_Timer::tick() {
+    if (_busy) {
+        _overruns++;
+        return;
+    }
+    _busy = true;
+    
+    // A command caught mid-write is simply picked up on the next tick
+    Command command;
+    if (_commands.read(command)) {
+        _pid.setpoint(command.setpoint);
+        if (command.gainsVersion != _appliedGains) {
+            _pid.setPID(command.Kp, command.Ki, command.Kd);
+            _appliedGains = command.gainsVersion;
+        }
+    }
+    
+    // Step the controller exactly one sample time, the timer is the clock
+    float input = _sensor();
+    _pid.updateAt(input, _pid._last_time + _pid._sample_time);
+    
+    Sample sample = {};  // Zeroed padding, the slot copies the raw bytes
+    sample.time = (uint32_t)_pid._last_time;
+    sample.input = input;
+    sample.output = _pid._output;
+    sample.error = _pid._errorState;
+    _samples.write(sample);
+    
+    _busy = false;
+}
+
+#if defined(ESP32)
+
+static hw_timer_t* s_timer = nullptr;
+static TaskHandle_t s_task = nullptr;
+
+static void IRAM_ATTR onTimer() {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(s_task, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
+
+static void timerTask(void*) {
+    for (;;) {
+        // More than one pending alarm means the last update overran its sample time
+        uint32_t pending = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        PID_Timer::isr(pending > 1 ? pending - 1 : 0);
+    }
+}
+
+bool PID_Timer::startHardware(unsigned long periodUs) {
+    if (!s_task) {
+        xTaskCreatePinnedToCore(timerTask, "pid_timer", PID_TIMER_TASK_STACK, nullptr,
+                                configMAX_PRIORITIES - 1, &s_task, portNUM_PROCESSORS - 1);
+        if (!s_task) return false;
+    }
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+    s_timer = timerBegin(1000000);
+    if (!s_timer) return false;
+    timerAttachInterrupt(s_timer, &onTimer);
+    timerAlarm(s_timer, periodUs, true, 0);
+#else
+    s_timer = timerBegin(0, 80, true);  // 1MHz from the 80MHz APB clock
+    if (!s_timer) return false;
+    timerAttachInterrupt(s_timer, &onTimer, true);
+    timerAlarmWrite(s_timer, periodUs, true);
+    timerAlarmEnable(s_timer);
+#endif
+    return true;
+}
+
+void PID_Timer::stopHardware() {
+    if (s_timer) {
+        timerEnd(s_timer);
+        s_timer = nullptr;
+    }
+}
+
+#elif defined(__AVR__) && defined(TCCR1A)
+
+bool PID_Timer::startHardware(unsigned long periodUs) {
+    // Smallest prescaler (CS1 = 1..5) whose count fits in 16 bits
+    static const uint16_t prescalers[] = { 1, 8, 64, 256, 1024 };
+    for (uint8_t i = 0; i < sizeof(prescalers) / sizeof(prescalers[0]); i++) {
+        unsigned long ticks = (F_CPU / 1000000UL) * periodUs / prescalers[i];
+        if (ticks == 0 || ticks > 65536UL) continue;
+        
+        noInterrupts();
+        TCCR1A = 0;
+        TCCR1B = _BV(WGM12) | (i + 1);  // CTC on OCR1A
+        TCNT1 = 0;
+        OCR1A = (uint16_t)(ticks - 1);
+        TIFR1 = _BV(OCF1A);
+        TIMSK1 |= _BV(OCIE1A);
+        interrupts();
+        return true;
+    }
+    return false;
+}
+
+void PID_Timer::stopHardware() {
+    TIMSK1 &= ~_BV(OCIE1A);
+    TCCR1B = 0;
+}
+
+#elif defined(ARDUINO_ARCH_SAMD) && !defined(__SAMD51__)
+
+static void tc3Sync() {
+    while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+}
+
+bool PID_Timer::startHardware(unsigned long periodUs) {
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TCC2_TC3;
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    
+    TC3->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+    tc3Sync();
+    
+    // Smallest prescaler (PRESCALER = 0..7) whose count fits in 16 bits
+    static const uint16_t prescalers[] = { 1, 2, 4, 8, 16, 64, 256, 1024 };
+    for (uint8_t i = 0; i < sizeof(prescalers) / sizeof(prescalers[0]); i++) {
+        unsigned long ticks = (F_CPU / 1000000UL) * periodUs / prescalers[i];
+        if (ticks == 0 || ticks > 65536UL) continue;
+        
+        TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER(i);
+        tc3Sync();
+        TC3->COUNT16.CC[0].reg = (uint16_t)(ticks - 1);
+        tc3Sync();
+        TC3->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+        NVIC_SetPriority(TC3_IRQn, 3);
+        NVIC_EnableIRQ(TC3_IRQn);
+        TC3->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+        tc3Sync();
+        return true;
+    }
+    return false;
+}
+
+void PID_Timer::stopHardware() {
+    TC3->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+    tc3Sync();
+    NVIC_DisableIRQ(TC3_IRQn);
+}
+
+#else
+
+// No supported hardware timer on this board
+bool PID_Timer::startHardware(unsigned long) {
+    return false;
+}
+
+void PID_Timer::stopHardware() {
+}
+
+#endif
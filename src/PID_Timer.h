@@ -0,0 +1,104 @@
+/**************************************************************************************************
+ * PID_Timer - Hardware-timer driven PID_Control updates
+ * 
+ * Runs a PID_Control from a hardware timer at exactly its sample time, so serial I/O, delay()
+ * and the rest of loop() no longer add sample jitter:
+ * - ESP32: hw_timer alarm waking a max-priority FreeRTOS task (float math stays out of the ISR)
+ * - AVR: Timer1 compare match ISR (interrupts stay enabled so millis() keeps running)
+ * - SAMD21: TC3 match ISR
+ * 
+ * The sensor is read through a callback in the timer context. Setpoint/gain changes and computed
+ * samples are handed between loop() and the timer through lock-free PID_SpscSlot's, so neither
+ * side ever blocks or disables interrupts. Each tick advances the controller by exactly one
+ * sample time, giving a deterministic dt for the integral and derivative terms.
+ * 
+ * On AVR and SAMD21, including this header defines the timer's interrupt handler, so include it
+ * from one file of the sketch only, and not together with another Timer1/TC3 user (e.g. Servo
+ * on AVR).
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <PID_Control.h>
+#include <PID_Spsc.h>
+
+#ifndef PID_TIMER_TASK_STACK
+#define PID_TIMER_TASK_STACK 4096
+#endif
+
+class PID_Timer {
+    public:
+        // Sensor reading callback, called from the timer context - keep it short
+        using SensorCallback = float (*)();
+        
+        // One computed sample, handed to loop() by read()
+        struct Sample {
+            uint32_t time;  // Controller time base (ms or us)
+            float input;
+            float output;
+            bool error;
+        };
+        
+        PID_Timer(PID_Control& pid);
+        
+        // Start updating the controller every sample time. Returns false if the board has
+        // no supported timer or another PID_Timer is already running.
+        bool begin(SensorCallback sensor);
+        void end();
+        bool isRunning();
+        
+        // Changes from loop(), applied at the start of the next tick
+        void setpoint(float setpoint);
+        void setPID(float Kp, float Ki, float Kd);
+        
+        // Latest sample from the timer, false if there is none since the last call
+        bool read(Sample& sample);
+        
+        // Ticks skipped because the previous update was still running
+        unsigned long getOverruns();
+        
+        // Timer entry point, called from the interrupt or timer task. missed counts alarms
+        // that were coalesced while the previous update was still running.
+        static void isr(unsigned long missed = 0);
+        
+    private:
+        struct Command {
+            float setpoint;
+            float Kp;
+            float Ki;
+            float Kd;
+            uint8_t gainsVersion;  // Gains are applied once per change, setPID() resets the integral
+        };
+        
+        void tick();
+        bool startHardware(unsigned long periodUs);
+        void stopHardware();
+        
+        PID_Control& _pid;
+        SensorCallback _sensor;
+        
+        PID_SpscSlot<Command> _commands;  // loop() -> timer
+        PID_SpscSlot<Sample> _samples;    // timer -> loop()
+        Command _command;                 // loop() side copy of the last command
+        uint8_t _appliedGains;            // timer side
+        
+        volatile bool _running;
+        volatile bool _busy;
+        volatile unsigned long _overruns;
+        
+        static PID_Timer* volatile _active;
+};
+
+#ifndef PID_TIMER_IMPLEMENTATION
+#if defined(__AVR__) && defined(TCCR1A)
+ISR(TIMER1_COMPA_vect, ISR_NOBLOCK) {
+    PID_Timer::isr();
+}
+#elif defined(ARDUINO_ARCH_SAMD) && !defined(__SAMD51__)
+void TC3_Handler() {
+    TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+    PID_Timer::isr();
+}
+#endif
+#endif
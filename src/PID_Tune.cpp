@@ -4,38 +4,137 @@
  **************************************************************************************************/
 
 #include "PID_Tune.h"
-#include <ArduinoJson.h>
 #include <HardwareSerial.h>
+#include <PID_Crc.h>
 
-PID_Tune::PID_Tune(PID_Control& pid) : _pid(pid) {
+static uint8_t* packFloat(uint8_t* dst, float value) {
+    memcpy(dst, &value, sizeof(value));
+    return dst + sizeof(value);
+}
+
+static uint8_t* packU32(uint8_t* dst, uint32_t value) {
+    dst[0] = (uint8_t)(value);
+    dst[1] = (uint8_t)(value >> 8);
+    dst[2] = (uint8_t)(value >> 16);
+    dst[3] = (uint8_t)(value >> 24);
+    return dst + 4;
+}
+
+static uint8_t* packSample(uint8_t* dst, const PID_Tune::Sample& sample) {
+    dst = packU32(dst, sample.time);
+    dst = packFloat(dst, sample.pv);
+    dst = packFloat(dst, sample.sp);
+    dst = packFloat(dst, sample.output);
+    dst = packFloat(dst, sample.P);
+    dst = packFloat(dst, sample.I);
+    return packFloat(dst, sample.D);
+}
+
+PID_Tune::PID_Tune(PID_Control& pid) {
+    init();
+    _pid = &pid;
+    _pid->setSampleCallback(onSample, this);
+}
+
+PID_Tune::PID_Tune(PID_Group& group) {
+    init();
+    _group = &group;  // Loop 0 is selected by begin(), once the sketch has added its loops
+}
+
+void PID_Tune::init() {
+    _pid = nullptr;
+    _group = nullptr;
+    _loopId = 0;
+    _activeLoop = 0;
     _enabled = false;
     _running = false;
+    _manual = false;
+    _resuming = false;
     _stepTestActive = false;
+    _stepEnding = false;
     _stepTestAmplitude = 10.0;
     _originalSetpoint = 0.0;
     _stepTestStartTime = 0;
+    _stepTestDuration = PID_TUNE_STEP_DURATION;
+    memset(&_step, 0, sizeof(_step));
+    _step.metrics.riseTime = -1.0;
+    _step.metrics.peakTime = -1.0;
+    _step.metrics.settlingTime = -1.0;
+    _autotuneActive = false;
+    _autotuneApply = true;
+    _storage = nullptr;
+    _autoSaveDelay = PID_TUNE_AUTOSAVE_DELAY;
+    _saveDirty = false;
+    _saveChangeTime = 0;
+    _saveReport = false;
+    _saveCount = 0;
+    _saveWrites = 0;
+    _captureCount = 0;
+    _captureStride = 1;
+    _captureSkip = 0;
+    _captureDropped = 0;
+    _capturing = false;
+    _dumpActive = false;
+    _dumpIndex = 0;
     _lastDataSend = 0;
-    _loopPeriod = 100;
+    _dataInterval = PID_TUNE_DATA_INTERVAL;
+    _adaptiveRate = false;
+    _allLoops = false;
+    _skippedSamples = 0;
+    _txCapacity = 0;
+    _exception = false;
+    _deltaFrames = false;
+    _pvBand = 0.0;
+    _outputBand = 0.0;
+    _heartbeat = PID_TUNE_HEARTBEAT_INTERVAL;
+    _suppressedSamples = 0;
+    memset(_reports, 0, sizeof(_reports));
+    _loopPeriodUs = 100000;
     _bufferIndex = 0;
     _buffer[0] = '\0';
+    _fieldCount = 0;
+    _dataFormat = FORMAT_JSON;
+    _frameSeq = 0;
+    _taskMode = false;
+    memset(&_snapshot, 0, sizeof(_snapshot));
+    _lastPublish = 0;
     _serial = nullptr;  // No serial port assigned yet
+    _out = nullptr;
+    _datagram = nullptr;
+    _txBudgetBytes = 0;
+    _txBudgetMicros = 0;
+    _rxBudget = 0;
 }
 
 // Implementation for Generic Stream (Assumes already initialized)
-void PID_Tune::begin(Stream& serial) {
+void PID_Tune::begin(Stream& serial, DataFormat format) {
     // This is the fallback for any Stream object (like USB Serial). 
     // It assumes the object is ready or that initialization is handled elsewhere.
     _serial = &serial;
+    _out = _tx.isAttached() ? (Print*)&_tx : (Print*)_serial;
+    _datagram = nullptr;
+    _dataFormat = format;
+    _txCapacity = 0;
+    
+    if (_group) {
+        selectLoop(0);
+    } else {
+        _loopPeriodUs = _pid->getSampleTimeUs();
+    }
     
     _enabled = true;
     sendStatus();
-    _serial->println("PID Tuning Interface Ready (Generic Stream)");
+    _out->println("PID Tuning Interface Ready (Generic Stream)");
 }
 
 
 // Implementation for HardwareSerial (Calls begin(baudRate))
-void PID_Tune::begin(HardwareSerial& serial, unsigned long baudRate) {
+void PID_Tune::begin(HardwareSerial& serial, unsigned long baudRate, DataFormat format) {
     _serial = &serial;
+    _out = _tx.isAttached() ? (Print*)&_tx : (Print*)_serial;
+    _datagram = nullptr;
+    _dataFormat = format;
+    _txCapacity = 0;
     
     // Call the specific HardwareSerial method
     serial.begin(baudRate);
@@ -43,9 +142,22 @@ void PID_Tune::begin(HardwareSerial& serial, unsigned long baudRate) {
     // Wait for the serial port to be ready
     while (!serial && millis() < 3000) delay(10);
     
+    if (_group) {
+        selectLoop(0);
+    } else {
+        _loopPeriodUs = _pid->getSampleTimeUs();
+    }
+    
     _enabled = true;
     sendStatus();
-    _serial->println("PID Tuning Interface Ready (HardwareSerial)");
+    _out->println("PID Tuning Interface Ready (HardwareSerial)");
+}
+
+// Implementation for UDP (socket opened by the sketch)
+void PID_Tune::begin(PID_UdpStream& udp, DataFormat format) {
+    begin((Stream&)udp, format);
+    _datagram = &udp;
+    udp.send();
 }
 
 void PID_Tune::setSensorCallback(SensorCallback callback) {
@@ -53,10 +165,11 @@ void PID_Tune::setSensorCallback(SensorCallback callback) {
 }
 
 void PID_Tune::update() {
-    if (!_enabled || !_serial) return;
+    if (!_enabled || !_serial || !_pid) return;
     
-    // Check for incoming commands
-    while (_serial->available()) {
+    // Check for incoming commands, at most _rxBudget characters per call
+    size_t received = 0;
+    while ((!_rxBudget || received++ < _rxBudget) && _serial->available()) {
         char c = _serial->read();
         if (c == '\n' || c == '\r') {
             if (_bufferIndex > 0) {
@@ -69,19 +182,128 @@ void PID_Tune::update() {
         }
     }
     
-    // Send data at fixed rate
-    unsigned long now = millis();
-    if (now - _lastDataSend >= DATA_SEND_INTERVAL) {
-        sendData();
+    // Send data at the configured rate, dropping the sample rather than blocking if asked to
+    // (always when buffered, the buffer would only drop it later)
+    unsigned long now = PID_Hal::millis();
+    if (now - _lastDataSend >= _dataInterval) {
+        if ((!_adaptiveRate && !_tx.isAttached()) || txReady(dataMessageSize())) {
+            sendData();
+        } else {
+            _skippedSamples++;
+        }
         _lastDataSend = now;
     }
     
+    // Stream a requested capture one chunk per call
+    drainCapture();
+    if (_dumpActive) {
+        sendCaptureChunk();
+    }
+    
     // Handle step test timing
-    if (_stepTestActive && (now - _stepTestStartTime >= 5000)) {
+    if (_stepTestActive && (now - _stepTestStartTime >= _stepTestDuration)) {
         stopStepTest();
     }
+    finishStepTest();
+    finishAutotune();
+    finishSave();
+    
+    // Hand buffered output to the port without blocking
+    if (_tx.isAttached()) {
+        _tx.drain(*_serial, _txBudgetBytes, _txBudgetMicros);
+    }
+    if (_datagram) _datagram->send();
 }
 
+void PID_Tune::setTxBuffer(uint8_t* buffer, size_t size) {
+    // Flush what is already queued so no message is cut; a port that takes nothing even once
+    // flushed gets the rest discarded
+    if (_tx.isAttached() && _serial) {
+        while (_tx.pending()) {
+            if (_tx.drain(*_serial)) continue;
+            _serial->flush();
+            if (!_tx.drain(*_serial)) break;
+        }
+    }
+    _tx.attach(buffer, size);
+    _out = _tx.isAttached() ? (Print*)&_tx : (Print*)_serial;
+}
+
+bool PID_Tune::isTxBuffered() {
+    return _tx.isAttached();
+}
+
+void PID_Tune::setUpdateBudget(size_t txBytes, unsigned long txMicros, size_t rxBytes) {
+    _txBudgetBytes = txBytes;
+    _txBudgetMicros = txMicros;
+    _rxBudget = rxBytes;
+}
+
+unsigned long PID_Tune::getDroppedFrames() {
+    return _tx.getDroppedFrames();
+}
+
+#if PID_TUNE_HAS_TASK_MODE
+void PID_Tune::setTaskMode(bool enabled) {
+    // Seed the snapshot while the sketch is still single-threaded
+    if (enabled && _pid) {
+        fillSnapshot(_snapshot);
+        _snapshot.sample.pv = readSensor();
+    }
+    _taskMode = enabled && _pid;
+}
+
+bool PID_Tune::isTaskMode() {
+    return _taskMode;
+}
+
+void PID_Tune::service() {
+    if (!_taskMode) return;
+    
+    bool changed = false;
+    Command command;
+    while (_commands.pop(command)) {
+        applyCommand(command);
+        changed = true;
+    }
+    if (_storage) _storage->update();
+    
+    // Publish at most once per millisecond, telemetry never runs faster than that
+    unsigned long now = PID_Hal::millis();
+    if (changed || now != _lastPublish) {
+        Snapshot state;
+        fillSnapshot(state);
+        state.sample.pv = readSensor();
+        _snapshots.write(state);
+        _lastPublish = now;
+    }
+}
+#endif
+
+#if defined(ESP32)
+void PID_Tune::taskLoop(void* context) {
+    PID_Tune* tune = static_cast<PID_Tune*>(context);
+    for (;;) {
+        tune->update();
+        vTaskDelay(1);
+    }
+}
+
+bool PID_Tune::beginTask(BaseType_t core, uint32_t stackSize, UBaseType_t priority) {
+    if (!_serial || _taskMode) return false;
+    
+    setTaskMode(true);
+    if (!_taskMode) return false;
+    
+    TaskHandle_t handle = nullptr;
+    if (xTaskCreatePinnedToCore(taskLoop, "pid_tune", stackSize, this, priority, &handle, core) != pdPASS) {
+        _taskMode = false;
+        return false;
+    }
+    return true;
+}
+#endif
+
 void PID_Tune::enable() {
     _enabled = true;
 }
@@ -94,88 +316,435 @@ bool PID_Tune::isEnabled() {
     return _enabled;
 }
 
+bool PID_Tune::selectLoop(uint8_t id) {
+    if (!_group || !_group->get(id) || _stepTestActive || _autotuneActive || _manual) return false;
+    
+    _loopId = id;
+    _loopPeriodUs = _group->get(id)->getSampleTimeUs();
+    apply(OP_SELECT_LOOP);
+    return true;
+}
+
+uint8_t PID_Tune::getSelectedLoop() {
+    return _loopId;
+}
+
+void PID_Tune::setGroupTelemetry(bool allLoops) {
+    _allLoops = allLoops;
+}
+
+bool PID_Tune::isGroupTelemetry() {
+    return _allLoops;
+}
+
 void PID_Tune::setSetpoint(float setpoint) {
-    _pid.setpoint(setpoint);
+    apply(OP_SETPOINT, setpoint);
 }
 
 float PID_Tune::getSetpoint() {
-    return _pid.getSetpoint();
+    return snapshot().sample.sp;
 }
 
 void PID_Tune::setPID(float Kp, float Ki, float Kd) {
-    _pid.setPID(Kp, Ki, Kd);
+    apply(OP_GAINS, Kp, Ki, Kd);
 }
 
 float PID_Tune::getKp() {
-    return _pid.getKp();
+    return snapshot().kp;
 }
 
 float PID_Tune::getKi() {
-    return _pid.getKi();
+    return snapshot().ki;
 }
 
 float PID_Tune::getKd() {
-    return _pid.getKd();
+    return snapshot().kd;
 }
 
 void PID_Tune::setLoopPeriod(unsigned long periodMs) {
-    _loopPeriod = periodMs;
-    _pid.setSampleTime(periodMs);
+    if (periodMs == 0) return;
+    _loopPeriodUs = periodMs * 1000;
+    applyPeriod(OP_SAMPLE_TIME, periodMs);
+}
+
+void PID_Tune::setLoopPeriodUs(unsigned long periodUs) {
+    if (periodUs == 0) return;
+    _loopPeriodUs = periodUs;
+    applyPeriod(OP_SAMPLE_TIME_US, periodUs);
 }
 
 unsigned long PID_Tune::getLoopPeriod() {
-    return _loopPeriod;
+    return _loopPeriodUs / 1000;
+}
+
+unsigned long PID_Tune::getLoopPeriodUs() {
+    return _loopPeriodUs;
 }
 
 void PID_Tune::setOutputLimits(float min, float max) {
-    _pid.setOutputLimits(min, max);
+    apply(OP_OUTPUT_LIMITS, min, max);
 }
 
 void PID_Tune::setIntegralLimits(float min, float max) {
-    _pid.setIntegralLimits(min, max);
+    apply(OP_INTEGRAL_LIMITS, min, max);
+}
+
+void PID_Tune::setDataFormat(DataFormat format) {
+    _dataFormat = format;
+    _frameSeq = 0;
+    memset(_reports, 0, sizeof(_reports));  // Full frames first
+}
+
+PID_Tune::DataFormat PID_Tune::getDataFormat() {
+    return _dataFormat;
+}
+
+void PID_Tune::setDataInterval(unsigned long intervalMs) {
+    if (intervalMs > 0) {
+        _dataInterval = intervalMs;
+    }
+}
+
+unsigned long PID_Tune::getDataInterval() {
+    return _dataInterval;
+}
+
+void PID_Tune::setAdaptiveRate(bool enabled) {
+    _adaptiveRate = enabled;
+    _skippedSamples = 0;
+}
+
+bool PID_Tune::isAdaptiveRate() {
+    return _adaptiveRate;
+}
+
+unsigned long PID_Tune::getSkippedSamples() {
+    return _skippedSamples;
+}
+
+void PID_Tune::setReportByException(bool enabled, float pvBand, float outputBand,
+                                    unsigned long heartbeatMs, bool deltaFrames) {
+    _exception = enabled;
+    _pvBand = fabs(pvBand);
+    _outputBand = fabs(outputBand);
+    _heartbeat = heartbeatMs > 0 ? heartbeatMs : 1;
+    _deltaFrames = deltaFrames;
+    _suppressedSamples = 0;
+    memset(_reports, 0, sizeof(_reports));
+}
+
+bool PID_Tune::isReportByException() {
+    return _exception;
+}
+
+unsigned long PID_Tune::getSuppressedSamples() {
+    return _suppressedSamples;
 }
 
 void PID_Tune::startStepTest(float amplitude) {
-    if (!_stepTestActive) {
+    if (!_stepTestActive && !_autotuneActive) {
         _stepTestAmplitude = amplitude;
-        _originalSetpoint = _pid.getSetpoint();
-        _pid.setpoint(_originalSetpoint + amplitude);
+        
+        // Restart the capture, the controller side adds a pre-step baseline sample
+        _dumpActive = false;
+        _captureCount = 0;
+        _captureStride = 1;
+        _captureSkip = 0;
+        _captureDropped = 0;
+        
+        apply(OP_STEP_BEGIN, amplitude);
         _stepTestActive = true;
-        _stepTestStartTime = millis();
+        _stepTestStartTime = PID_Hal::millis();
         
         // Notify the Python app
-        _serial->print("{\"type\": \"step_test_started\", \"amplitude\": ");
-        _serial->print(_stepTestAmplitude, 2);
-        _serial->println("}");
+        _out->print("{\"type\": \"step_test_started\", \"amplitude\": ");
+        _out->print(_stepTestAmplitude, 2);
+        _out->print(", \"duration\": ");
+        _out->print(_stepTestDuration);
+        _out->println("}");
     }
 }
 
 void PID_Tune::stopStepTest() {
-    if (_stepTestActive) {
-        _pid.setpoint(_originalSetpoint);
-        _stepTestActive = false;
-        _serial->println("{\"type\": \"step_test_complete\"}");
+    if (_stepTestActive && !_stepEnding) {
+        _stepEnding = true;
+        apply(OP_STEP_END);
+        finishStepTest();
+    }
+}
+
+// Report the end of a step test once the controller side has stopped capturing
+void PID_Tune::finishStepTest() {
+    if (!_stepEnding || _capturing) return;
+    PID_SPSC_BARRIER();
+    drainCapture();
+    
+    _stepEnding = false;
+    _stepTestActive = false;
+    
+    StepMetrics& metrics = _step.metrics;
+    metrics.overshoot = _step.peak > 1.0 ? (_step.peak - 1.0) * 100.0 : 0.0;
+    if (_step.outside) metrics.settlingTime = -1.0;
+    
+    _out->print("{\"type\": \"step_test_complete\", \"captured\": ");
+    _out->print(_captureCount);
+    _out->print(", \"samples\": ");
+    _out->print(metrics.samples);
+    _out->print(", \"rise_time\": ");
+    printMetric(metrics.riseTime, 4);
+    _out->print(", \"overshoot\": ");
+    _out->print(metrics.overshoot, 2);
+    _out->print(", \"peak_time\": ");
+    printMetric(metrics.peakTime, 4);
+    _out->print(", \"settling_time\": ");
+    printMetric(metrics.settlingTime, 4);
+    _out->print(", \"steady_state_error\": ");
+    _out->print(metrics.steadyStateError, 4);
+    _out->print(", \"iae\": ");
+    _out->print(metrics.iae, 4);
+    _out->print(", \"ise\": ");
+    _out->print(metrics.ise, 4);
+    _out->println("}");
+}
+
+// Negative times were not reached
+void PID_Tune::printMetric(float value, int digits) {
+    if (value < 0.0) {
+        _out->print("null");
+    } else {
+        _out->print(value, digits);
+    }
+}
+
+void PID_Tune::setStepTestDuration(unsigned long durationMs) {
+    if (durationMs > 0) {
+        _stepTestDuration = durationMs;
+    }
+}
+
+unsigned long PID_Tune::getStepTestDuration() {
+    return _stepTestDuration;
+}
+
+const PID_Tune::StepMetrics& PID_Tune::getStepMetrics() {
+    return _step.metrics;
+}
+
+// Controller side: start tracking from the pre-step sample
+void PID_Tune::beginStepMetrics(const Sample& baseline, float step) {
+    memset(&_step, 0, sizeof(_step));
+    _step.metrics.riseTime = -1.0;
+    _step.metrics.peakTime = -1.0;
+    _step.metrics.settlingTime = -1.0;
+    _step.start = baseline.time;
+    _step.last = baseline.time;
+    _step.secondsPerTick = _pid->isMicros() ? 1e-6 : 1e-3;
+    _step.initial = baseline.pv;
+    _step.span = baseline.sp + step - baseline.pv;
+    if (fabs(_step.span) < 1e-6) _step.span = step != 0.0 ? step : 1.0;
+    _step.rise10 = -1.0;
+    _step.outside = true;
+}
+
+// Controller side: fold one sample into the metrics, O(1) per sample
+void PID_Tune::trackStep(const Sample& sample) {
+    StepMetrics& metrics = _step.metrics;
+    float dt = (sample.time - _step.last) * _step.secondsPerTick;
+    float elapsed = (sample.time - _step.start) * _step.secondsPerTick;
+    _step.last = sample.time;
+    
+    float error = sample.sp - sample.pv;
+    metrics.iae += fabs(error) * dt;
+    metrics.ise += error * error * dt;
+    metrics.steadyStateError = error;
+    metrics.samples++;
+    
+    // Response as a fraction of the step, so rising and falling steps are handled alike
+    float y = (sample.pv - _step.initial) / _step.span;
+    if (_step.rise10 < 0.0 && y >= 0.1) _step.rise10 = elapsed;
+    if (metrics.riseTime < 0.0 && y >= 0.9) metrics.riseTime = elapsed - _step.rise10;
+    if (metrics.peakTime < 0.0 || y > _step.peak) {
+        _step.peak = y;
+        metrics.peakTime = elapsed;
     }
+    
+    _step.outside = fabs(y - 1.0) > PID_TUNE_SETTLING_BAND;
+    if (_step.outside) metrics.settlingTime = elapsed;
 }
 
 bool PID_Tune::isStepTestActive() {
     return _stepTestActive;
 }
 
+bool PID_Tune::startAutotune(float amplitude, float hysteresis, bool applyGains) {
+    if (_autotuneActive || _stepTestActive || amplitude <= 0.0) return false;
+    
+    // Settings and the cleared state are written before the command releases them
+    _autotune.reset();
+    _autotune.setRelay(amplitude, hysteresis);
+    _autotuneApply = applyGains;
+    if (!apply(OP_AUTOTUNE_BEGIN)) return false;
+    _autotuneActive = true;
+    _manual = false;  // The relay takes over, the controller is left in automatic after it
+    
+    _out->print("{\"type\": \"autotune_started\", \"amplitude\": ");
+    _out->print(amplitude, 2);
+    _out->print(", \"hysteresis\": ");
+    _out->print(hysteresis, 3);
+    _out->println("}");
+    return true;
+}
+
+void PID_Tune::stopAutotune() {
+    if (_autotuneActive) apply(OP_AUTOTUNE_END);
+}
+
+bool PID_Tune::isAutotuneActive() {
+    return _autotuneActive;
+}
+
+PID_Autotune& PID_Tune::getAutotune() {
+    return _autotune;
+}
+
+// Report the autotune result once the controller side has finished
+void PID_Tune::finishAutotune() {
+    if (!_autotuneActive) return;
+    
+    PID_Autotune::State state = _autotune.getState();
+    if (state != PID_Autotune::DONE && state != PID_Autotune::FAILED) return;
+    PID_SPSC_BARRIER();
+    _autotuneActive = false;
+    
+    if (state == PID_Autotune::FAILED) {
+        const char* reason;
+        switch (_autotune.getFailure()) {
+            case PID_Autotune::FAILURE_TIMEOUT:   reason = "timeout";   break;
+            case PID_Autotune::FAILURE_DISABLED:  reason = "disabled";  break;
+            case PID_Autotune::FAILURE_AMPLITUDE: reason = "amplitude"; break;
+            default:                              reason = "stopped";   break;
+        }
+        _out->print("{\"type\": \"autotune_failed\", \"reason\": \"");
+        _out->print(reason);
+        _out->println("\"}");
+        return;
+    }
+    
+    const char* rule;
+    switch (_autotune.getRule()) {
+        case PID_Autotune::ZIEGLER_NICHOLS_PI: rule = "zn_pi"; break;
+        case PID_Autotune::TYREUS_LUYBEN:      rule = "tl";    break;
+        case PID_Autotune::TYREUS_LUYBEN_PI:   rule = "tl_pi"; break;
+        default:                               rule = "zn";    break;
+    }
+    if (_autotuneApply) setPID(_autotune.getKp(), _autotune.getKi(), _autotune.getKd());
+    
+    _out->print("{\"type\": \"autotune_complete\", \"ku\": ");
+    _out->print(_autotune.getUltimateGain(), 4);
+    _out->print(", \"tu\": ");
+    _out->print(_autotune.getUltimatePeriod(), 4);
+    _out->print(", \"kp\": ");
+    _out->print(_autotune.getKp(), 4);
+    _out->print(", \"ki\": ");
+    _out->print(_autotune.getKi(), 4);
+    _out->print(", \"kd\": ");
+    _out->print(_autotune.getKd(), 4);
+    _out->print(", \"rule\": \"");
+    _out->print(rule);
+    _out->print("\", \"applied\": ");
+    _out->print(_autotuneApply ? "true" : "false");
+    _out->println("}");
+}
+
+void PID_Tune::setStorage(PID_Storage* storage, unsigned long autoSaveDelay) {
+    _storage = storage;
+    _autoSaveDelay = autoSaveDelay;
+    _saveDirty = false;
+    _saveReport = false;
+}
+
+bool PID_Tune::save() {
+    // A running test has the setpoint or output away from what should be kept
+    if (!_storage || _storage->isBusy() || _stepTestActive || _autotuneActive) return false;
+    if (!apply(OP_SAVE)) return false;
+    _saveDirty = false;
+    return true;
+}
+
+// Tuner side: autosave once changes have been left alone, and report a "save" command's result
+// when the controller side has finished it
+void PID_Tune::finishSave() {
+    if (!_storage) return;
+    
+    // Without task mode the controller side is this call
+    if (!_taskMode) _storage->update();
+    
+    if (_saveDirty && _autoSaveDelay > 0 && PID_Hal::millis() - _saveChangeTime >= _autoSaveDelay) {
+        save();
+    }
+    
+    if (_saveReport && _storage->getSaves() != _saveCount) {
+        PID_SPSC_BARRIER();
+        _saveReport = false;
+        _out->print("{\"type\": \"saved\", \"written\": ");
+        _out->print(_storage->getWrites() != _saveWrites ? "true" : "false");
+        _out->print(", \"sequence\": ");
+        _out->print(_storage->getSequence());
+        _out->println("}");
+    }
+}
+
+bool PID_Tune::isCaptureActive() {
+    return _capturing;
+}
+
+uint16_t PID_Tune::getCaptureCount() {
+    return _captureCount;
+}
+
+bool PID_Tune::getCaptureSample(uint16_t index, Sample& sample) {
+    if (index >= _captureCount) return false;
+    sample = _capture[index];
+    return true;
+}
+
+void PID_Tune::dumpCapture() {
+    if (!_serial) return;
+    
+    if (_capturing) {
+        _out->println("{\"error\": \"Capture in progress\"}");
+        return;
+    }
+    
+    _out->print("{\"type\": \"capture_begin\", \"count\": ");
+    _out->print(_captureCount);
+    _out->print(", \"stride\": ");
+    _out->print(_captureStride);
+    _out->print(", \"dropped\": ");
+    _out->print(_captureDropped);
+    _out->print(", \"time_unit\": \"");
+    _out->print(snapshot().micros ? "us" : "ms");
+    _out->println("\"}");
+    
+    // Chunks follow from update() so a long dump never stalls the loop
+    _dumpIndex = 0;
+    _dumpActive = true;
+}
+
 void PID_Tune::start() {
     _running = true;
-    _pid.enable();  // Enable PID when starting
+    apply(OP_ENABLE);  // Enable PID when starting
     if (_serial) {
-        _serial->println("{\"type\": \"debug\", \"debug\": \"Control started\"}");
+        _out->println("{\"type\": \"debug\", \"debug\": \"Control started\"}");
         sendStatus();  // Send status update
     }
 }
 
 void PID_Tune::stop() {
     _running = false;
-    _pid.disable();  // Disable PID to force output to 0
+    apply(OP_DISABLE);  // Disable PID to force output to 0
     if (_serial) {
-        _serial->println("{\"type\": \"debug\", \"debug\": \"Control stopped\"}");
+        _out->println("{\"type\": \"debug\", \"debug\": \"Control stopped\"}");
         sendStatus();  // Send status update
     }
 }
@@ -184,143 +753,993 @@ bool PID_Tune::isRunning() {
     return _running;
 }
 
+void PID_Tune::setManualOutput(float output) {
+    stopAutotune();  // The relay would take the output back
+    if (!apply(OP_MANUAL, output)) return;
+    _manual = true;
+}
+
+void PID_Tune::setAutomatic() {
+    if (!_manual || !apply(OP_AUTOMATIC)) return;
+    _manual = false;
+}
+
+bool PID_Tune::isManual() {
+    return _manual;
+}
+
 float PID_Tune::getProcessValue() {
-    return readSensor();
+    return snapshot(true).sample.pv;
 }
 
 float PID_Tune::getOutput() {
-    return _pid.getOutput();
+    return snapshot().sample.output;
 }
 
 float PID_Tune::getError() {
-    return _pid.getError();
+    return snapshot().error;
 }
 
 float PID_Tune::getProportional() {
-    return _pid.getProportional();
+    return snapshot().sample.P;
 }
 
 float PID_Tune::getIntegral() {
-    return _pid.getIntegral();
+    return snapshot().sample.I;
 }
 
 float PID_Tune::getDerivative() {
-    return _pid.getDerivative();
+    return snapshot().sample.D;
 }
 
 // Private methods
 
-void PID_Tune::processCommand() {
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, _buffer);
+// Run a controller change now, or queue it for service() in task mode
+bool PID_Tune::apply(uint8_t op, float a, float b, float c, float d) {
+    Command command = { op, _loopId, { a }, b, c, d };
+    return submit(command);
+}
+
+bool PID_Tune::applyPeriod(uint8_t op, uint32_t period) {
+    Command command = { op, _loopId, { 0.0 }, 0.0, 0.0, 0.0 };
+    command.period = period;
+    return submit(command);
+}
+
+bool PID_Tune::submit(const Command& command) {
+    // Stored parameters changed: restart the autosave quiet time
+    switch (command.op) {
+        case OP_SETPOINT:
+        case OP_GAINS:
+        case OP_SAMPLE_TIME:
+        case OP_SAMPLE_TIME_US:
+        case OP_OUTPUT_LIMITS:
+        case OP_INTEGRAL_LIMITS:
+        case OP_SCHEDULE_CLEAR:
+        case OP_SCHEDULE_POINT:
+            _saveDirty = true;
+            _saveChangeTime = PID_Hal::millis();
+            break;
+    }
     
-    if (error) {
-        _serial->println("{\"error\": \"Invalid JSON\"}");
-        return;
+#if PID_TUNE_HAS_TASK_MODE
+    if (_taskMode) {
+        if (!_commands.push(command)) {
+            if (_serial) _out->println("{\"error\": \"Command queue full\"}");
+            return false;
+        }
+        return true;
     }
+#endif
+    applyCommand(command);
+    return true;
+}
+
+// Controller side: the only place PID_Tune changes the controller
+void PID_Tune::applyCommand(const Command& command) {
+    switch (command.op) {
+        case OP_SETPOINT:
+            _pid->setpoint(command.a);
+            break;
+        case OP_GAINS:
+            _pid->setPID(command.a, command.b, command.c);
+            break;
+        case OP_SAMPLE_TIME:
+            // A millisecond period leaves a micros() controller on micros()
+            if (_pid->isMicros()) {
+                _pid->setSampleTimeUs((unsigned long)command.period * 1000);
+            } else {
+                _pid->setSampleTime(command.period);
+            }
+            break;
+        case OP_SAMPLE_TIME_US:
+            _pid->setSampleTimeUs(command.period);
+            break;
+        case OP_OUTPUT_LIMITS:
+            _pid->setOutputLimits(command.a, command.b);
+            break;
+        case OP_INTEGRAL_LIMITS:
+            _pid->setIntegralLimits(command.a, command.b);
+            break;
+        case OP_ENABLE:
+            // Resume through one manual sample at the present output (0 after stop()): it seeds
+            // the integral from a fresh error, so automatic carries on without a bump
+            _pid->enable();
+            if (!_pid->isManual()) {
+                _pid->setManualOutput(_pid->getOutput());
+                _pid->setManual(true);
+                _resuming = true;
+            }
+            break;
+        case OP_DISABLE:
+            endResume();
+            _pid->disable();
+            _autotune.update();  // A disabled controller no longer samples, end the test here
+            break;
+        case OP_SELECT_LOOP:
+            // Move the capture hook to the newly selected loop
+            if (_pid) {
+                endResume();
+                _pid->setSampleCallback(nullptr);
+            }
+            _activeLoop = command.loop;
+            _pid = _group->get(command.loop);
+            _pid->setSampleCallback(onSample, this);
+            break;
+        case OP_STEP_BEGIN: {
+            _originalSetpoint = _pid->getSetpoint();
+            
+            Snapshot baseline;
+            fillSnapshot(baseline);
+            baseline.sample.time = _pid->isMicros() ? PID_Hal::micros() : PID_Hal::millis();
+            baseline.sample.pv = readSensor();
+            captureSample(baseline.sample);
+            beginStepMetrics(baseline.sample, command.a);
+            _capturing = true;
+            
+            _pid->setpoint(_originalSetpoint + command.a);
+            break;
+        }
+        case OP_STEP_END:
+            _pid->setpoint(_originalSetpoint);
+            _capturing = false;
+            break;
+        case OP_RESET_STATS:
+#if PID_CONTROL_STATS
+            _pid->resetStats();
+#endif
+            break;
+        case OP_AUTOTUNE_BEGIN:
+            endResume();
+            _autotune.setController(*_pid);
+            _autotune.start();  // A failed start is reported through the FAILED state
+            break;
+        case OP_AUTOTUNE_END:
+            _autotune.stop();
+            break;
+        case OP_SCHEDULE_CLEAR:
+            if (PID_GainSchedule* schedule = _pid->getGainSchedule()) {
+                schedule->clear();
+                if (command.a >= 0.0) schedule->setSource((PID_GainSchedule::Source)command.a);
+            }
+            break;
+        case OP_SCHEDULE_POINT:
+            if (PID_GainSchedule* schedule = _pid->getGainSchedule()) {
+                schedule->addPoint(command.a, command.b, command.c, command.d);
+            }
+            break;
+        case OP_SAVE:
+            if (_storage) _storage->save(*_pid);
+            break;
+        case OP_MANUAL:
+            _resuming = false;  // Stays in manual
+            _pid->setManualOutput(command.a);
+            _pid->setManual(true);
+            break;
+        case OP_AUTOMATIC:
+            _resuming = false;
+            _pid->setManual(false);
+            break;
+    }
+}
+
+// Controller side: back to automatic after start()'s tracking sample
+void PID_Tune::endResume() {
+    if (!_resuming) return;
+    _resuming = false;
+    _pid->setManual(false);
+}
+
+// Controller state for the tuner: the copy last published by service() in task mode, read from
+// the controller directly otherwise. The sensor is only read when readInput is set.
+const PID_Tune::Snapshot& PID_Tune::snapshot(bool readInput) {
+#if PID_TUNE_HAS_TASK_MODE
+    if (_taskMode) {
+        _snapshots.read(_snapshot);  // Keeps the previous copy if nothing new is ready
+        return _snapshot;
+    }
+#endif
+    fillSnapshot(_snapshot);
+    if (readInput) _snapshot.sample.pv = readSensor();
+    return _snapshot;
+}
+
+void PID_Tune::fillSnapshot(Snapshot& state) {
+    fillSnapshot(state, *_pid, _activeLoop);
+}
+
+void PID_Tune::fillSnapshot(Snapshot& state, PID_Control& pid, uint8_t loop) {
+    state.sample.time = PID_Hal::millis();
+    state.sample.pv = pid.getInput();
+    state.sample.sp = pid.getSetpoint();
+    state.sample.output = pid.getOutput();
+    state.sample.P = pid.getProportional();
+    state.sample.I = pid.getIntegral();
+    state.sample.D = pid.getDerivative();
+    state.error = pid.getError();
+    state.kp = pid.getKp();
+    state.ki = pid.getKi();
+    state.kd = pid.getKd();
+    state.micros = pid.isMicros();
+    state.scheduled = pid.getGainSchedule() != nullptr;
+    state.loop = loop;
+}
+
+// FNV-1a hash, constexpr so command and key names fold into switch labels at compile time
+static constexpr uint32_t hashKey(const char* s, uint32_t h = 2166136261UL) {
+    return *s ? hashKey(s + 1, (h ^ (uint8_t)*s) * 16777619UL) : h;
+}
+
+// Hash of a JSON string body, up to the closing quote
+static uint32_t hashString(const char* s) {
+    uint32_t h = 2166136261UL;
+    while (*s && *s != '"') {
+        if (*s == '\\' && s[1]) s++;
+        h = (h ^ (uint8_t)*s++) * 16777619UL;
+    }
+    return h;
+}
+
+static const char* skipSpace(const char* p) {
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+// Skip one JSON value (string, number, literal, array or object); returns nullptr if malformed
+static const char* skipValue(const char* p) {
+    if (*p == '"') {
+        for (p++; *p && *p != '"'; p++) {
+            if (*p == '\\' && p[1]) p++;
+        }
+        return *p == '"' ? p + 1 : nullptr;
+    }
+    if (*p == '[' || *p == '{') {
+        int depth = 0;
+        for (; *p; p++) {
+            if (*p == '"') {
+                p = skipValue(p);
+                if (!p) return nullptr;
+                p--;
+            } else if (*p == '[' || *p == '{') {
+                depth++;
+            } else if ((*p == ']' || *p == '}') && --depth == 0) {
+                return p + 1;
+            }
+        }
+        return nullptr;
+    }
+    const char* start = p;
+    while (*p && *p != ',' && *p != '}' && *p != ' ' && *p != '\t') p++;
+    return p == start ? nullptr : p;
+}
+
+// Tokenize the flat JSON object in _buffer into key hash / value pointer pairs.
+// Values are left in place and decoded on demand, so nothing is copied or allocated.
+bool PID_Tune::parseFields() {
+    _fieldCount = 0;
+    const char* p = skipSpace(_buffer);
+    if (*p++ != '{') return false;
     
-    String cmd = doc["cmd"];
+    p = skipSpace(p);
+    if (*p == '}') return true;
     
-    if (cmd == "set_params") {
-        // Handle PID parameters - need to set all three at once
-        float kp = _pid.getKp();
-        float ki = _pid.getKi();
-        float kd = _pid.getKd();
+    while (true) {
+        if (*p != '"') return false;
+        uint32_t key = hashString(p + 1);
+        p = skipValue(p);
+        if (!p) return false;
         
-        if (doc["kp"].is<float>()) kp = doc["kp"];
-        if (doc["ki"].is<float>()) ki = doc["ki"];
-        if (doc["kd"].is<float>()) kd = doc["kd"];
+        p = skipSpace(p);
+        if (*p++ != ':') return false;
+        p = skipSpace(p);
         
-        _pid.setPID(kp, ki, kd);
+        const char* value = p;
+        p = skipValue(p);
+        if (!p) return false;
         
-        if (doc["loop_period"].is<unsigned long>()) setLoopPeriod(doc["loop_period"]);
+        if (_fieldCount < PID_TUNE_MAX_FIELDS) {
+            _fields[_fieldCount].key = key;
+            _fields[_fieldCount].value = value;
+            _fieldCount++;
+        }
         
-        // Handle anti-windup settings
-        if (doc["output_limit"].is<bool>()) {
-            if (doc["output_limit"]) {
-                if (doc["output_min"].is<float>() && doc["output_max"].is<float>()) {
-                    setOutputLimits(doc["output_min"], doc["output_max"]);
+        p = skipSpace(p);
+        if (*p == '}') return true;
+        if (*p++ != ',') return false;
+        p = skipSpace(p);
+    }
+}
+
+const char* PID_Tune::findField(uint32_t key) {
+    for (uint8_t i = 0; i < _fieldCount; i++) {
+        if (_fields[i].key == key) return _fields[i].value;
+    }
+    return nullptr;
+}
+
+// Next number of a JSON array of numbers or of number arrays, e.g. [[200, 2, 0.5], [1000, 1, 0.2]];
+// nullptr at the end of the outer array or on anything else. depth starts at 0 on the bracket.
+static const char* nextNumber(const char* p, int& depth, float& value) {
+    for (; *p; p++) {
+        if (*p == '[') {
+            depth++;
+        } else if (*p == ']') {
+            if (--depth == 0) return nullptr;
+        } else if (*p == '-' || *p == '.' || (*p >= '0' && *p <= '9')) {
+            char* end;
+            value = (float)strtod(p, &end);
+            return end;
+        } else if (*p != ',' && *p != ' ' && *p != '\t') {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+bool PID_Tune::getFloat(uint32_t key, float& value) {
+    const char* v = findField(key);
+    if (!v || !(*v == '-' || *v == '.' || (*v >= '0' && *v <= '9'))) return false;
+    value = (float)strtod(v, nullptr);
+    return true;
+}
+
+bool PID_Tune::getULong(uint32_t key, unsigned long& value) {
+    const char* v = findField(key);
+    if (!v || *v < '0' || *v > '9') return false;
+    value = strtoul(v, nullptr, 10);
+    return true;
+}
+
+bool PID_Tune::getBool(uint32_t key, bool& value) {
+    const char* v = findField(key);
+    if (!v) return false;
+    if (strncmp(v, "true", 4) == 0) value = true;
+    else if (strncmp(v, "false", 5) == 0) value = false;
+    else return false;
+    return true;
+}
+
+uint32_t PID_Tune::getStringHash(uint32_t key) {
+    const char* v = findField(key);
+    return (v && *v == '"') ? hashString(v + 1) : 0;
+}
+
+void PID_Tune::processCommand() {
+    if (!parseFields()) {
+        _out->println("{\"error\": \"Invalid JSON\"}");
+        return;
+    }
+    
+    // In group mode "loop" selects which controller this and later commands address
+    unsigned long loop;
+    if (_group && getULong(hashKey("loop"), loop) && loop != _loopId) {
+        if (loop > 255 || !selectLoop((uint8_t)loop)) {
+            _out->println("{\"error\": \"Invalid loop\"}");
+            return;
+        }
+    }
+    
+    switch (getStringHash(hashKey("cmd"))) {
+        case hashKey("set_params"): {
+            // Handle PID parameters - need to set all three at once
+            const Snapshot& state = snapshot();
+            float kp = state.kp;
+            float ki = state.ki;
+            float kd = state.kd;
+            
+            getFloat(hashKey("kp"), kp);
+            getFloat(hashKey("ki"), ki);
+            getFloat(hashKey("kd"), kd);
+            
+            setPID(kp, ki, kd);
+            
+            unsigned long period;
+            if (getULong(hashKey("loop_period_us"), period)) {
+                setLoopPeriodUs(period);
+            } else if (getULong(hashKey("loop_period"), period)) {
+                setLoopPeriod(period);
+            }
+            
+            // Handle anti-windup settings
+            bool limit;
+            float min, max;
+            if (getBool(hashKey("output_limit"), limit) && limit) {
+                if (getFloat(hashKey("output_min"), min) && getFloat(hashKey("output_max"), max)) {
+                    setOutputLimits(min, max);
                 }
             }
-        }
-        
-        if (doc["integral_limit"].is<bool>()) {
-            if (doc["integral_limit"]) {
-                if (doc["integral_min"].is<float>() && doc["integral_max"].is<float>()) {
-                    setIntegralLimits(doc["integral_min"], doc["integral_max"]);
+            
+            if (getBool(hashKey("integral_limit"), limit) && limit) {
+                if (getFloat(hashKey("integral_min"), min) && getFloat(hashKey("integral_max"), max)) {
+                    setIntegralLimits(min, max);
                 }
             }
+            break;
         }
-    }
-    else if (cmd == "set_sp") {
-        if (doc["value"].is<float>()) {
-            setSetpoint(doc["value"]);
+        case hashKey("set_sp"): {
+            float value;
+            if (getFloat(hashKey("value"), value)) {
+                setSetpoint(value);
+            }
+            break;
+        }
+        case hashKey("start"):
+            _out->println("{\"type\": \"debug\", \"debug\": \"Received start command\"}");
+            start();
+            break;
+        case hashKey("stop"):
+            _out->println("{\"type\": \"debug\", \"debug\": \"Received stop command\"}");
+            stop();
+            break;
+        case hashKey("manual"): {
+            // Without an output the present one is held
+            float output;
+            if (!getFloat(hashKey("output"), output)) output = snapshot().sample.output;
+            setManualOutput(output);
+            sendStatus();
+            break;
+        }
+        case hashKey("auto"):
+            setAutomatic();
+            sendStatus();
+            break;
+        case hashKey("get_status"):
+            sendStatus();
+            break;
+        case hashKey("step_test"): {
+            float amplitude;
+            unsigned long duration;
+            if (getULong(hashKey("duration"), duration)) setStepTestDuration(duration);
+            if (getFloat(hashKey("amplitude"), amplitude)) {
+                startStepTest(amplitude);
+            }
+            break;
         }
+        case hashKey("set_format"):
+            // The acknowledgement is always JSON so the host knows when to switch decoders
+            switch (getStringHash(hashKey("format"))) {
+                case hashKey("binary"): setDataFormat(FORMAT_BINARY); break;
+                case hashKey("json"):   setDataFormat(FORMAT_JSON);   break;
+            }
+            sendFormat();
+            break;
+        case hashKey("autotune"):
+            processAutotune();
+            break;
+        case hashKey("set_schedule"):
+            processSetSchedule();
+            break;
+        case hashKey("save"):
+            if (!_storage) {
+                _out->println("{\"error\": \"No storage\"}");
+                break;
+            }
+            _saveCount = _storage->getSaves();
+            _saveWrites = _storage->getWrites();
+            if (save()) {
+                _saveReport = true;
+            } else {
+                _out->println("{\"error\": \"Save failed\"}");
+            }
+            break;
+        case hashKey("autotune_stop"):
+            stopAutotune();
+            break;
+        case hashKey("dump_capture"):
+            dumpCapture();
+            break;
+        case hashKey("set_rate"): {
+            unsigned long interval;
+            bool adaptive;
+            if (getULong(hashKey("interval"), interval)) setDataInterval(interval);
+            if (getBool(hashKey("adaptive"), adaptive)) setAdaptiveRate(adaptive);
+            
+            // Report by exception; fields left out keep their value
+            bool exception = _exception;
+            bool delta = _deltaFrames;
+            float pvBand = _pvBand;
+            float outputBand = _outputBand;
+            unsigned long heartbeat = _heartbeat;
+            bool changed = getBool(hashKey("exception"), exception);
+            changed |= getBool(hashKey("delta"), delta);
+            changed |= getFloat(hashKey("pv_band"), pvBand);
+            changed |= getFloat(hashKey("output_band"), outputBand);
+            changed |= getULong(hashKey("heartbeat"), heartbeat);
+            if (changed) setReportByException(exception, pvBand, outputBand, heartbeat, delta);
+            sendStatus();
+            break;
+        }
+        case hashKey("get_stats"): {
+            sendStats();
+            bool reset;
+            if (getBool(hashKey("reset"), reset) && reset) apply(OP_RESET_STATS);
+            break;
+        }
+        default:
+            _out->println("{\"error\": \"Unknown command\"}");
+            break;
     }
-    else if (cmd == "start") {
-        _serial->println("{\"type\": \"debug\", \"debug\": \"Received start command\"}");
-        start();
+}
+
+// {"cmd": "set_schedule", "source": "pv", "points": [[x, kp, ki, kd], ...]} replaces the
+// attached gain schedule in one command; the points are checked before anything is queued
+void PID_Tune::processSetSchedule() {
+    if (!snapshot().scheduled) {
+        _out->println("{\"error\": \"No gain schedule\"}");
+        return;
     }
-    else if (cmd == "stop") {
-        _serial->println("{\"type\": \"debug\", \"debug\": \"Received stop command\"}");
-        stop();
+    
+    const char* points = findField(hashKey("points"));
+    if (!points || *points != '[') {
+        _out->println("{\"error\": \"Schedule needs points\"}");
+        return;
+    }
+    
+    int depth = 0;
+    float value;
+    int count = 0;
+    for (const char* p = points; (p = nextNumber(p, depth, value)) != nullptr; ) count++;
+    if (count % 4 != 0 || count / 4 > PID_GAIN_SCHEDULE_SIZE) {
+        _out->println("{\"error\": \"Invalid schedule\"}");
+        return;
     }
-    else if (cmd == "get_status") {
-        sendStatus();
+    
+    float source = -1.0;  // Keep the current one
+    switch (getStringHash(hashKey("source"))) {
+        case hashKey("pv"):       source = PID_GainSchedule::SOURCE_INPUT;    break;
+        case hashKey("setpoint"): source = PID_GainSchedule::SOURCE_SETPOINT; break;
     }
-    else if (cmd == "step_test") {
-        if (doc["amplitude"].is<float>()) {
-            startStepTest(doc["amplitude"]);
+    if (!apply(OP_SCHEDULE_CLEAR, source)) return;
+    
+    depth = 0;
+    float point[4];
+    int n = 0;
+    for (const char* p = points; (p = nextNumber(p, depth, point[n])) != nullptr; ) {
+        if (++n == 4) {
+            if (!apply(OP_SCHEDULE_POINT, point[0], point[1], point[2], point[3])) return;
+            n = 0;
         }
     }
-    else {
-        _serial->println("{\"error\": \"Unknown command\"}");
+    
+    _out->print("{\"type\": \"schedule\", \"points\": ");
+    _out->print(count / 4);
+    _out->println("}");
+}
+
+void PID_Tune::processAutotune() {
+    float amplitude;
+    if (!getFloat(hashKey("amplitude"), amplitude) || amplitude <= 0.0) {
+        _out->println("{\"error\": \"Autotune needs an amplitude\"}");
+        return;
+    }
+    if (_autotuneActive || _stepTestActive) {
+        _out->println("{\"error\": \"Test already running\"}");
+        return;
     }
+    
+    float hysteresis = 0.0;
+    getFloat(hashKey("hysteresis"), hysteresis);
+    
+    switch (getStringHash(hashKey("rule"))) {
+        case hashKey("zn"):    _autotune.setRule(PID_Autotune::ZIEGLER_NICHOLS);    break;
+        case hashKey("zn_pi"): _autotune.setRule(PID_Autotune::ZIEGLER_NICHOLS_PI); break;
+        case hashKey("tl"):    _autotune.setRule(PID_Autotune::TYREUS_LUYBEN);      break;
+        case hashKey("tl_pi"): _autotune.setRule(PID_Autotune::TYREUS_LUYBEN_PI);   break;
+    }
+    
+    unsigned long value;
+    if (getULong(hashKey("cycles"), value)) _autotune.setCycles(value > 255 ? 255 : (uint8_t)value);
+    if (getULong(hashKey("timeout"), value)) _autotune.setTimeout(value);
+    
+    bool applyGains = true;
+    getBool(hashKey("apply"), applyGains);
+    
+    startAutotune(amplitude, hysteresis, applyGains);
 }
 
 void PID_Tune::sendData() {
     if (!_serial) return;
+    unsigned long now = PID_Hal::millis();
+    
+    // Every loop of the group back to back, so they share one datagram over UDP. The other
+    // loops belong to the control core in task mode, which only publishes the selected one.
+    if (_group && _allLoops && !_taskMode) {
+        for (uint8_t id = 0; id < _group->size(); id++) {
+            if (id == _activeLoop) {
+                reportSample(snapshot(true), now);
+                continue;
+            }
+            Snapshot state;
+            fillSnapshot(state, *_group->get(id), id);
+            state.sample.pv = _group->getInput(id);
+            reportSample(state, now);
+        }
+        return;
+    }
+    reportSample(snapshot(true), now);
+}
+
+// Report by exception: send the sample only if it moved past a band or the heartbeat is due
+void PID_Tune::reportSample(const Snapshot& state, unsigned long time) {
+    if (!_exception || state.loop >= PID_TUNE_REPORT_LOOPS) {
+        sendSample(state, time);
+        return;
+    }
+    
+    Report& report = _reports[state.loop];
+    const Sample& sample = state.sample;
+    if (report.valid && time - report.sent.time < _heartbeat &&
+        fabs(sample.pv - report.sent.pv) <= _pvBand &&
+        fabs(sample.output - report.sent.output) <= _outputBand &&
+        sample.sp == report.sent.sp) {
+        _suppressedSamples++;
+        return;
+    }
+    
+    Sample current = sample;
+    current.time = time;
+    if (_deltaFrames && _dataFormat == FORMAT_BINARY && report.valid &&
+        time - report.keyTime < _heartbeat && sendDelta(report, current, state.loop)) {
+        return;
+    }
+    sendSample(state, time);
+    report.sent = current;
+    report.keyTime = time;
+    report.valid = true;
+}
+
+// Delta frame against the loop's last frame; false when a change doesn't fit, for a full frame
+bool PID_Tune::sendDelta(Report& report, const Sample& sample, uint8_t loop) {
+    const float current[6] = { sample.pv, sample.sp, sample.output, sample.P, sample.I, sample.D };
+    float* sent[6] = { &report.sent.pv, &report.sent.sp, &report.sent.output,
+                       &report.sent.P, &report.sent.I, &report.sent.D };
+    unsigned long dt = sample.time - report.sent.time;
+    if (dt > 0xFFFF) return false;
     
-    float pv = readSensor();
-    float sp = _pid.getSetpoint();
-    float output = _pid.getOutput();
+    uint8_t payload[16];
+    int16_t steps[6];
+    uint8_t mask = 0;
+    uint8_t length = 3;
+    for (uint8_t i = 0; i < 6; i++) {
+        float step = roundf((current[i] - *sent[i]) * (float)(1.0 / PID_TUNE_DELTA_RESOLUTION));
+        if (!(fabs(step) <= 32767.0f)) return false;  // Also NaN
+        steps[i] = (int16_t)step;
+        if (steps[i] == 0) continue;
+        mask |= 1 << i;
+        payload[length++] = (uint8_t)(steps[i] & 0xFF);
+        payload[length++] = (uint8_t)((uint16_t)steps[i] >> 8);
+    }
+    payload[0] = mask;
+    payload[1] = (uint8_t)(dt & 0xFF);
+    payload[2] = (uint8_t)(dt >> 8);
+    if (_group) payload[length++] = loop;
+    sendFrame(PID_TUNE_FRAME_DELTA, payload, length);
+    
+    // Follow the values as the host rebuilds them, so rounding doesn't add up
+    for (uint8_t i = 0; i < 6; i++) {
+        *sent[i] += steps[i] * (float)PID_TUNE_DELTA_RESOLUTION;
+    }
+    report.sent.time = sample.time;
+    return true;
+}
+
+void PID_Tune::sendSample(const Snapshot& state, unsigned long time) {
+    float pv = state.sample.pv;
+    float sp = state.sample.sp;
+    float output = state.sample.output;
     float error = sp - pv;
-    unsigned long time = millis();
     
     // Get PID components
-    float P = _pid.getProportional();
-    float I = _pid.getIntegral();
-    float D = _pid.getDerivative();
-    
-    // Send data JSON
-    _serial->print("{\"type\": \"data\", ");
-    _serial->print("\"pv\": " + String(pv, 2) + ", ");
-    _serial->print("\"sp\": " + String(sp, 2) + ", ");
-    _serial->print("\"output\": " + String(output, 0) + ", ");
-    _serial->print("\"error\": " + String(error, 2) + ", ");
-    _serial->print("\"P\": " + String(P, 2) + ", ");
-    _serial->print("\"I\": " + String(I, 2) + ", ");
-    _serial->print("\"D\": " + String(D, 2) + ", ");
-    _serial->println("\"time\": " + String(time) + "}");
+    float P = state.sample.P;
+    float I = state.sample.I;
+    float D = state.sample.D;
+    
+    if (_dataFormat == FORMAT_BINARY) {
+        // Error is left out of the frame, the host derives it from sp - pv
+        // In group mode a trailing byte carries the loop id
+        Sample sample = { (uint32_t)time, pv, sp, output, P, I, D };
+        uint8_t payload[29];
+        packSample(payload, sample);
+        payload[28] = state.loop;
+        sendFrame(PID_TUNE_FRAME_DATA, payload, _group ? 29 : 28);
+        return;
+    }
+    
+    // Send data JSON, printing each field directly so no String temporaries are built
+    _out->print("{\"type\": \"data\", \"pv\": ");
+    _out->print(pv, 2);
+    _out->print(", \"sp\": ");
+    _out->print(sp, 2);
+    _out->print(", \"output\": ");
+    _out->print(output, 0);
+    _out->print(", \"error\": ");
+    _out->print(error, 2);
+    _out->print(", \"P\": ");
+    _out->print(P, 2);
+    _out->print(", \"I\": ");
+    _out->print(I, 2);
+    _out->print(", \"D\": ");
+    _out->print(D, 2);
+    _out->print(", \"time\": ");
+    _out->print(time);
+    if (_group) {
+        _out->print(", \"loop\": ");
+        _out->print(state.loop);
+    }
+    _out->println("}");
+}
+
+void PID_Tune::sendFrame(uint8_t type, const uint8_t* payload, uint8_t length) {
+    uint8_t header[4] = { PID_TUNE_FRAME_SYNC, length, type, _frameSeq++ };
+    
+    uint16_t crc = PID_CRC16_INIT;
+    for (uint8_t i = 1; i < sizeof(header); i++) crc = pidCrc16Update(crc, header[i]);
+    for (uint8_t i = 0; i < length; i++) crc = pidCrc16Update(crc, payload[i]);
+    uint8_t trailer[2] = { (uint8_t)(crc & 0xFF), (uint8_t)(crc >> 8) };
+    
+    if (_tx.isAttached()) _tx.beginFrame();
+    _out->write(header, sizeof(header));
+    _out->write(payload, length);
+    _out->write(trailer, sizeof(trailer));
+    if (_tx.isAttached()) _tx.endFrame();
+}
+
+// Worst case bytes one sendData() needs in the TX buffer
+size_t PID_Tune::dataMessageSize() {
+    size_t size = _dataFormat == FORMAT_BINARY ? 34 : 160;
+    if (_group && _allLoops && !_taskMode) size *= _group->size();  // One sample per loop
+    return size;
+}
+
+// Free space in whatever the messages are written to
+int PID_Tune::txSpace() {
+    return _tx.isAttached() ? _tx.availableForWrite() : _serial->availableForWrite();
+}
+
+// Room for a message of need bytes. A port's TX buffer can be smaller than the message (64 bytes
+// on AVR) or not report its space at all (Print's default of 0): the message then goes once the
+// buffer is as empty as it gets, or always, and the write blocks for what doesn't fit.
+bool PID_Tune::txReady(size_t need) {
+    int space = txSpace();
+    if (_tx.isAttached()) return space >= (int)need;
+    if (space > _txCapacity) _txCapacity = space;
+    return _txCapacity == 0 || space >= (int)need || space >= _txCapacity;
+}
+
+void PID_Tune::sendCaptureChunk() {
+    uint16_t count = _captureCount - _dumpIndex;
+    if (count > PID_TUNE_CAPTURE_CHUNK) count = PID_TUNE_CAPTURE_CHUNK;
+    
+    // Shrink the chunk to the free TX space (worst case sizes), or wait for the next call
+    if (_adaptiveRate || _tx.isAttached()) {
+        bool binary = _dataFormat == FORMAT_BINARY;
+        int space = txSpace();
+        if (count == 0) {
+            if (!txReady(48)) return;  // capture_end
+        } else {
+            // At least one sample once the port is ready for it, even if it can't hold a chunk
+            int header = binary ? 8 : 56;
+            int sample = binary ? 28 : 96;
+            int fit = (space - header) / sample;
+            if (fit <= 0) {
+                if (!txReady(header + sample)) return;
+                fit = 1;
+            }
+            if (count > fit) count = fit;
+        }
+    }
+    
+    if (count == 0) {
+        _dumpActive = false;
+        _out->print("{\"type\": \"capture_end\", \"count\": ");
+        _out->print(_captureCount);
+        _out->println("}");
+        return;
+    }
+    
+    Sample sample = {};
+    if (_dataFormat == FORMAT_BINARY) {
+        // Payload: uint16 index of the first sample, then the samples in order
+        uint8_t payload[2 + PID_TUNE_CAPTURE_CHUNK * 28];
+        payload[0] = (uint8_t)(_dumpIndex);
+        payload[1] = (uint8_t)(_dumpIndex >> 8);
+        uint8_t* p = payload + 2;
+        for (uint16_t i = 0; i < count; i++) {
+            getCaptureSample(_dumpIndex + i, sample);
+            p = packSample(p, sample);
+        }
+        sendFrame(PID_TUNE_FRAME_CAPTURE, payload, (uint8_t)(p - payload));
+    } else {
+        _out->print("{\"type\": \"capture\", \"index\": ");
+        _out->print(_dumpIndex);
+        _out->print(", \"samples\": [");
+        for (uint16_t i = 0; i < count; i++) {
+            getCaptureSample(_dumpIndex + i, sample);
+            _out->print(i ? ", [" : "[");
+            _out->print((unsigned long)sample.time);
+            _out->print(", ");
+            _out->print(sample.pv, 3);
+            _out->print(", ");
+            _out->print(sample.sp, 3);
+            _out->print(", ");
+            _out->print(sample.output, 2);
+            _out->print(", ");
+            _out->print(sample.P, 3);
+            _out->print(", ");
+            _out->print(sample.I, 3);
+            _out->print(", ");
+            _out->print(sample.D, 3);
+            _out->print("]");
+        }
+        _out->println("]}");
+    }
+    _dumpIndex += count;
+}
+
+void PID_Tune::sendFormat() {
+    if (!_serial) return;
+    
+    _out->print("{\"type\": \"format\", \"format\": \"");
+    _out->print(_dataFormat == FORMAT_BINARY ? "binary" : "json");
+    _out->println("\"}");
 }
 
 void PID_Tune::sendStatus() {
     if (!_serial) return;
     
-    _serial->print("{\"type\": \"status\", ");
-    _serial->print("\"running\": " + String(_running ? "true" : "false") + ", ");
-    _serial->print("\"kp\": " + String(_pid.getKp(), 3) + ", ");
-    _serial->print("\"ki\": " + String(_pid.getKi(), 4) + ", ");
-    _serial->print("\"kd\": " + String(_pid.getKd(), 4) + ", ");
-    _serial->print("\"sp\": " + String(_pid.getSetpoint(), 2) + ", ");
-    _serial->print("\"loop_period\": " + String(_loopPeriod));
-    _serial->println("}");
+    _out->print("{\"type\": \"status\", \"running\": ");
+    _out->print(_running ? "true" : "false");
+    _out->print(", \"manual\": ");
+    _out->print(_manual ? "true" : "false");
+    const Snapshot& state = snapshot();
+    _out->print(", \"kp\": ");
+    _out->print(state.kp, 3);
+    _out->print(", \"ki\": ");
+    _out->print(state.ki, 4);
+    _out->print(", \"kd\": ");
+    _out->print(state.kd, 4);
+    _out->print(", \"sp\": ");
+    _out->print(state.sample.sp, 2);
+    _out->print(", \"loop_period\": ");
+    _out->print(_loopPeriodUs / 1000);
+    _out->print(", \"loop_period_us\": ");
+    _out->print(_loopPeriodUs);
+    _out->print(", \"data_interval\": ");
+    _out->print(_dataInterval);
+    _out->print(", \"adaptive\": ");
+    _out->print(_adaptiveRate ? "true" : "false");
+    _out->print(", \"skipped\": ");
+    _out->print(_skippedSamples);
+    _out->print(", \"tx_dropped\": ");
+    _out->print(_tx.getDroppedFrames());
+    _out->print(", \"exception\": ");
+    _out->print(_exception ? "true" : "false");
+    _out->print(", \"suppressed\": ");
+    _out->print(_suppressedSamples);
+    _out->print(", \"autotune\": ");
+    _out->print(_autotuneActive ? "true" : "false");
+    if (_group) {
+        _out->print(", \"loop\": ");
+        _out->print(_loopId);
+        _out->print(", \"loops\": ");
+        _out->print(_group->size());
+    }
+    _out->println("}");
+}
+
+void PID_Tune::sendStats() {
+    if (!_serial) return;
+    
+#if PID_CONTROL_STATS
+    // Read as-is from the controller; in task mode a figure may be one sample newer than another
+    const PID_Stats& stats = _pid->getStats();
+    _out->print("{\"type\": \"stats\", \"samples\": ");
+    _out->print(stats.samples);
+    _out->print(", \"exec_min_us\": ");
+    _out->print(stats.samples ? (float)stats.execMin / PID_STATS_TICKS_PER_US : 0.0f, 2);
+    _out->print(", \"exec_max_us\": ");
+    _out->print((float)stats.execMax / PID_STATS_TICKS_PER_US, 2);
+    _out->print(", \"exec_mean_us\": ");
+    _out->print(_pid->getExecTimeMeanUs(), 2);
+    _out->print(", \"dt_min\": ");
+    _out->print(stats.samples ? stats.dtMin : 0UL);
+    _out->print(", \"dt_max\": ");
+    _out->print(stats.dtMax);
+    _out->print(", \"dt_mean\": ");
+    _out->print(_pid->getDtMean(), 2);
+    _out->print(", \"sample_time\": ");
+    _out->print(_pid->isMicros() ? _pid->getSampleTimeUs() : _pid->getSampleTime());
+    _out->print(", \"time_unit\": \"");
+    _out->print(_pid->isMicros() ? "us" : "ms");
+    _out->print("\", \"overruns\": ");
+    _out->print(stats.overruns);
+    _out->print(", \"skipped\": ");
+    _out->print(stats.skipped);
+    _out->print(", \"cycles\": ");
+    _out->print(PID_STATS_CYCLES ? "true" : "false");
+    _out->println("}");
+#else
+    _out->println("{\"error\": \"Stats not enabled, build with PID_CONTROL_STATS=1\"}");
+#endif
+}
+
+void PID_Tune::onSample(void* context) {
+    PID_Tune* tune = static_cast<PID_Tune*>(context);
+    tune->endResume();
+    tune->_autotune.update();
+    if (!tune->_capturing) return;
+    
+    PID_Control* pid = tune->_pid;
+    Sample sample = { (uint32_t)pid->getLastUpdateTime(), pid->getInput(), pid->getSetpoint(), pid->getOutput(),
+                      pid->getProportional(), pid->getIntegral(), pid->getDerivative() };
+    tune->trackStep(sample);
+    tune->captureSample(sample);
+}
+
+// Controller side: hand a capture sample to the tuner
+void PID_Tune::captureSample(const Sample& sample) {
+#if PID_TUNE_HAS_TASK_MODE
+    if (_taskMode) {
+        if (!_captureQueue.push(sample)) _captureDropped++;
+        return;
+    }
+#endif
+    recordSample(sample);
+}
+
+// Tuner side: move queued capture samples into the capture buffer
+void PID_Tune::drainCapture() {
+#if PID_TUNE_HAS_TASK_MODE
+    Sample sample;
+    while (_captureQueue.pop(sample)) {
+        recordSample(sample);
+    }
+#endif
+}
+
+void PID_Tune::recordSample(const Sample& sample) {
+    // Keep one sample in _captureStride. A full buffer keeps every other sample and doubles the
+    // stride, so the whole test window fits, from the baseline and the step onset on, at the
+    // finest rate the buffer allows.
+    if (++_captureSkip < _captureStride) return;
+    _captureSkip = 0;
+    
+    if (_captureCount == PID_TUNE_CAPTURE_SIZE) {
+        for (uint16_t i = 0; i < PID_TUNE_CAPTURE_SIZE / 2; i++) _capture[i] = _capture[2 * i];
+        _captureCount = PID_TUNE_CAPTURE_SIZE / 2;
+        _captureStride *= 2;
+    }
+    _capture[_captureCount++] = sample;
 }
 
 float PID_Tune::readSensor() {
     if (_sensorCallback) {
         return _sensorCallback();
     }
+    // The group has already read the selected loop's sensor
+    if (_group) {
+        return _group->getInput(_loopId);
+    }
     // Return 0 if no callback is set
     return 0.0;
 }
@@ -6,17 +6,29 @@
  * 
  * Features:
  * - Serial communication with Python tuning app
- * - JSON protocol for robust data exchange
- * - Step response testing
+ * - JSON protocol for robust data exchange (allocation-free parser)
+ * - Step response testing, with rise/settling time, overshoot and IAE/ISE computed on-device
  * - Real-time parameter adjustment
  * - Callback function for sensor reading
  * - Configurable serial port (Serial, Serial1, Serial2, etc.)
+ * - Optional compact binary telemetry frames (allocation-free)
+ * - Multi-loop tuning of a PID_Group, loops addressed by id
+ * - Task mode for dual-core ESP32/RP2040: serial I/O on its own core, lock-free hand-over
+ * - On-device relay autotune, only the resulting gains are reported
+ * - Networked tuning over UDP (PID_UdpStream), one datagram per update, multicast capable
  **************************************************************************************************/
 
 #pragma once
 
 #include <Arduino.h>
 #include <PID_Control.h>
+#include <PID_Autotune.h>
+#include <PID_GainSchedule.h>
+#include <PID_Storage.h>
+#include <PID_Group.h>
+#include <PID_Spsc.h>
+#include <PID_TxBuffer.h>
+#include <PID_UdpStream.h>
 #include <functional>
 #include <HardwareSerial.h>
 
@@ -24,19 +36,153 @@
 #define PID_TUNE_BUFFER_SIZE 256
 #endif
 
+// Maximum number of key/value pairs read from one command line
+#ifndef PID_TUNE_MAX_FIELDS
+#define PID_TUNE_MAX_FIELDS 16
+#endif
+
+// Binary telemetry frame layout (all multi-byte fields little-endian):
+//   [SYNC 0xA5][LEN][TYPE][SEQ][payload: LEN bytes][CRC16 lo][CRC16 hi]
+// CRC16 is CCITT-FALSE (poly 0x1021, init 0xFFFF) over LEN, TYPE, SEQ and payload.
+#define PID_TUNE_FRAME_SYNC 0xA5
+#define PID_TUNE_FRAME_DATA 0x01
+#define PID_TUNE_FRAME_CAPTURE 0x02
+// Delta frame payload: [mask][dt u16 ms][int16 per mask bit][loop id in group mode]. Mask bits
+// 0-5 are pv, sp, output, P, I, D; each int16 is the change since the loop's previous frame in
+// units of PID_TUNE_DELTA_RESOLUTION, dt the time since it.
+#define PID_TUNE_FRAME_DELTA 0x03
+
+// Samples held by the on-device step test capture (28 bytes each)
+#ifndef PID_TUNE_CAPTURE_SIZE
+#if defined(__AVR__)
+#define PID_TUNE_CAPTURE_SIZE 16
+#else
+#define PID_TUNE_CAPTURE_SIZE 256
+#endif
+#endif
+
+// Capture samples sent per chunk by dump_capture
+#define PID_TUNE_CAPTURE_CHUNK 8
+
+// Default step test length in milliseconds
+#ifndef PID_TUNE_STEP_DURATION
+#define PID_TUNE_STEP_DURATION 5000
+#endif
+
+// Settling band of the step test metrics, as a fraction of the step
+#ifndef PID_TUNE_SETTLING_BAND
+#define PID_TUNE_SETTLING_BAND 0.02
+#endif
+
+// Quiet time after the last parameter change before it is saved to storage, in milliseconds
+#ifndef PID_TUNE_AUTOSAVE_DELAY
+#define PID_TUNE_AUTOSAVE_DELAY 5000
+#endif
+
+// Default telemetry interval in milliseconds (10Hz)
+#ifndef PID_TUNE_DATA_INTERVAL
+#define PID_TUNE_DATA_INTERVAL 100
+#endif
+
+// Report by exception: longest gap between samples of a loop, and between its full frames
+// when delta frames are on, in milliseconds
+#ifndef PID_TUNE_HEARTBEAT_INTERVAL
+#define PID_TUNE_HEARTBEAT_INTERVAL 1000
+#endif
+
+// Step of the values in delta frames
+#ifndef PID_TUNE_DELTA_RESOLUTION
+#define PID_TUNE_DELTA_RESOLUTION 0.01
+#endif
+
+// Loops whose last sent sample is kept for report by exception; higher ids always report
+#ifndef PID_TUNE_REPORT_LOOPS
+#if defined(__AVR__)
+#define PID_TUNE_REPORT_LOOPS 4
+#else
+#define PID_TUNE_REPORT_LOOPS PID_GROUP_MAX_LOOPS
+#endif
+#endif
+
+// Task mode: update() runs on another core or task than the controller and all controller
+// access goes through lock-free queues serviced by service()
+#ifndef PID_TUNE_HAS_TASK_MODE
+#if defined(ESP32) || defined(ARDUINO_ARCH_RP2040)
+#define PID_TUNE_HAS_TASK_MODE 1
+#else
+#define PID_TUNE_HAS_TASK_MODE 0
+#endif
+#endif
+
+// Controller changes and capture samples that can be in flight between the two sides. A
+// set_schedule upload queues one change per breakpoint plus one.
+#ifndef PID_TUNE_COMMAND_QUEUE
+#define PID_TUNE_COMMAND_QUEUE 16
+#endif
+#ifndef PID_TUNE_CAPTURE_QUEUE
+#define PID_TUNE_CAPTURE_QUEUE 32
+#endif
+
+// beginTask() defaults; the Arduino loop() runs on core 1 of the ESP32
+#ifndef PID_TUNE_TASK_CORE
+#define PID_TUNE_TASK_CORE 0
+#endif
+#ifndef PID_TUNE_TASK_STACK
+#define PID_TUNE_TASK_STACK 4096
+#endif
+#ifndef PID_TUNE_TASK_PRIORITY
+#define PID_TUNE_TASK_PRIORITY 1
+#endif
+
 class PID_Tune {
     public:
         // Callback function type for sensor reading
         using SensorCallback = std::function<float()>;
         
+        // Telemetry encoding for "data" messages
+        enum DataFormat {
+            FORMAT_JSON,    // One JSON line per sample (default)
+            FORMAT_BINARY   // Framed binary sample, see PID_TUNE_FRAME_* above
+        };
+        
+        // One PID sample, as sent in telemetry and held by the capture buffer
+        struct Sample {
+            uint32_t time;
+            float pv;
+            float sp;
+            float output;
+            float P;
+            float I;
+            float D;
+        };
+        
+        // Step response of the last step test, computed sample by sample on the device.
+        // Times are in seconds from the step; a time that wasn't reached is negative.
+        struct StepMetrics {
+            float riseTime;          // 10% to 90% of the step
+            float overshoot;         // Peak past the target, percent of the step
+            float peakTime;
+            float settlingTime;      // Last time outside the PID_TUNE_SETTLING_BAND band
+            float steadyStateError;  // sp - pv at the end of the test
+            float iae;               // Integral of |sp - pv| dt
+            float ise;               // Integral of (sp - pv)^2 dt
+            uint32_t samples;
+        };
+        
         // Constructor
         PID_Tune(PID_Control& pid);
         
+        // Tune the loops of a group; add the loops before calling begin()
+        PID_Tune(PID_Group& group);
+        
         // Initialize the tuning interface (any Stream)
-        void begin(Stream& serial);
+        void begin(Stream& serial, DataFormat format = FORMAT_JSON);
         
         // Initialize with specific serial port
-        void begin(HardwareSerial& serial, unsigned long baudRate = 115200);
+        void begin(HardwareSerial& serial, unsigned long baudRate = 115200, DataFormat format = FORMAT_JSON);
+        
+        // Initialize over UDP: what one update() writes is sent as one datagram
+        void begin(PID_UdpStream& udp, DataFormat format = FORMAT_BINARY);
         
         // Set the sensor reading callback function
         void setSensorCallback(SensorCallback callback);
@@ -44,11 +190,37 @@ class PID_Tune {
         // Main update function - call this in your loop()
         void update();
         
+#if PID_TUNE_HAS_TASK_MODE
+        // Task mode, switched on after begin(): update() then runs on the other core (RP2040
+        // loop1(), or the task started by beginTask()) and the control loop calls service()
+        void setTaskMode(bool enabled);
+        bool isTaskMode();
+        
+        // Control side of task mode: apply queued changes and publish the controller state.
+        // Call it next to the controller's update().
+        void service();
+#endif
+        
+#if defined(ESP32)
+        // Enter task mode with update() in its own FreeRTOS task pinned to the given core
+        bool beginTask(BaseType_t core = PID_TUNE_TASK_CORE, uint32_t stackSize = PID_TUNE_TASK_STACK,
+                       UBaseType_t priority = PID_TUNE_TASK_PRIORITY);
+#endif
+        
         // Enable/disable the tuning interface
         void enable();
         void disable();
         bool isEnabled();
         
+        // Group mode: choose the loop that commands and telemetry refer to
+        bool selectLoop(uint8_t id);
+        uint8_t getSelectedLoop();
+        
+        // Group mode: telemetry for every loop each interval instead of the selected one only
+        // (the selected one only in task mode)
+        void setGroupTelemetry(bool allLoops);
+        bool isGroupTelemetry();
+        
         // Setpoint control
         void setSetpoint(float setpoint);
         float getSetpoint();
@@ -59,24 +231,96 @@ class PID_Tune {
         float getKi();
         float getKd();
         
-        // Control loop period
+        // Control loop period. setLoopPeriod() keeps a controller on the micros() time base
+        // there (setSampleTimeUs()), setLoopPeriodUs() moves it to micros().
         void setLoopPeriod(unsigned long periodMs);
-        unsigned long getLoopPeriod();
+        void setLoopPeriodUs(unsigned long periodUs);
+        unsigned long getLoopPeriod();    // ms, rounded down
+        unsigned long getLoopPeriodUs();
         
         // Output and integral limits
         void setOutputLimits(float min, float max);
         void setIntegralLimits(float min, float max);
         
+        // Telemetry format (also selectable by the host with "set_format")
+        void setDataFormat(DataFormat format);
+        DataFormat getDataFormat();
+        
+        // Telemetry rate (also settable by the host with "set_rate")
+        void setDataInterval(unsigned long intervalMs);
+        unsigned long getDataInterval();
+        
+        // Adaptive rate: skip a sample instead of blocking when the TX buffer can't take it.
+        // Requires a Stream that implements availableForWrite() and a TX buffer larger than the
+        // samples sent per interval; otherwise queue them with setTxBuffer().
+        void setAdaptiveRate(bool enabled);
+        bool isAdaptiveRate();
+        unsigned long getSkippedSamples();
+        
+        // Report by exception (also settable with "set_rate"): a loop's sample is only sent when
+        // pv or output moved more than their band, or the setpoint changed, since the last one
+        // sent, or when heartbeatMs has passed. With deltaFrames binary telemetry sends changes
+        // as PID_TUNE_FRAME_DELTA frames, with a full frame every heartbeat.
+        void setReportByException(bool enabled, float pvBand = 0.0, float outputBand = 0.0,
+                                  unsigned long heartbeatMs = PID_TUNE_HEARTBEAT_INTERVAL,
+                                  bool deltaFrames = false);
+        bool isReportByException();
+        unsigned long getSuppressedSamples();
+        
+        // Buffered output: messages are queued in buffer (sketch-owned, nullptr to turn off) and
+        // update() hands them to the port only as fast as availableForWrite() allows, so printing
+        // never blocks. Messages that don't fit are dropped whole and counted.
+        void setTxBuffer(uint8_t* buffer, size_t size);
+        bool isTxBuffered();
+        unsigned long getDroppedFrames();
+        
+        // Per update() limits on bytes sent, time spent sending (buffered output only) and
+        // characters read; 0 means no limit
+        void setUpdateBudget(size_t txBytes, unsigned long txMicros = 0, size_t rxBytes = 0);
+        
+        // Parameter storage (sketch-owned, nullptr to turn off) for the selected loop. Gain,
+        // setpoint, limit, sample time and schedule changes are saved once they have been left
+        // alone for autoSaveDelay ms (0 = only on save() or the "save" command). Restoring at
+        // boot is up to the sketch, see PID_Storage.
+        void setStorage(PID_Storage* storage, unsigned long autoSaveDelay = PID_TUNE_AUTOSAVE_DELAY);
+        bool save();
+        
         // Step test control
         void startStepTest(float amplitude);
         void stopStepTest();
         bool isStepTestActive();
+        void setStepTestDuration(unsigned long durationMs);  // Also "duration" of "step_test"
+        unsigned long getStepTestDuration();
+        const StepMetrics& getStepMetrics();  // Valid once isStepTestActive() is false again
+        
+        // Relay autotune of the selected loop at loop rate. Results are reported with an
+        // "autotune_complete" message and loaded into the controller when applyGains is set.
+        // Rule, cycle count and timeout are taken from getAutotune().
+        bool startAutotune(float amplitude, float hysteresis = 0.0, bool applyGains = true);
+        void stopAutotune();
+        bool isAutotuneActive();
+        PID_Autotune& getAutotune();
+        
+        // Step test capture: PID samples during the test are recorded, at loop rate until the
+        // buffer fills and then decimated by two each time it fills again (see dumpCapture()'s
+        // "stride"). PID_Tune installs itself as the controller's sample callback to do this.
+        bool isCaptureActive();
+        uint16_t getCaptureCount();
+        bool getCaptureSample(uint16_t index, Sample& sample);  // index 0 is the oldest
+        void dumpCapture();
         
         // Manual control
         void start();
         void stop();
         bool isRunning();
         
+        // Operator intervention: hold the controller's output at a value while it keeps
+        // sampling, then back to automatic without a bump (the integral tracks the held output).
+        // An autotune is stopped first; loop selection waits for automatic.
+        void setManualOutput(float output);
+        void setAutomatic();
+        bool isManual();
+        
         // Get current values
         float getProcessValue();
         float getOutput();
@@ -88,28 +332,171 @@ class PID_Tune {
         float getDerivative();
         
     private:
-        PID_Control& _pid;  // Reference to the PID controller
+        // Controller change, applied at once or by service() in task mode
+        enum CommandOp : uint8_t {
+            OP_SETPOINT,
+            OP_GAINS,
+            OP_SAMPLE_TIME,     // period in ms
+            OP_SAMPLE_TIME_US,  // period in us
+            OP_OUTPUT_LIMITS,
+            OP_INTEGRAL_LIMITS,
+            OP_ENABLE,
+            OP_DISABLE,
+            OP_SELECT_LOOP,
+            OP_STEP_BEGIN,
+            OP_STEP_END,
+            OP_RESET_STATS,
+            OP_AUTOTUNE_BEGIN,
+            OP_AUTOTUNE_END,
+            OP_SCHEDULE_CLEAR,
+            OP_SCHEDULE_POINT,
+            OP_SAVE,
+            OP_MANUAL,
+            OP_AUTOMATIC
+        };
+        
+        struct Command {
+            uint8_t op;
+            uint8_t loop;
+            union {
+                float a;
+                uint32_t period;  // OP_SAMPLE_TIME(_US): exact, a float only holds 24 bits
+            };
+            float b;
+            float c;
+            float d;
+        };
+        
+        // Controller state as the tuner sees it
+        struct Snapshot {
+            Sample sample;
+            float error;
+            float kp;
+            float ki;
+            float kd;
+            bool micros;
+            bool scheduled;  // A gain schedule is attached
+            uint8_t loop;
+        };
+        
+        PID_Control* _pid;  // The PID controller (selected loop in group mode), owned by the control side
+        PID_Group* _group;
+        uint8_t _loopId;      // Loop selected by the tuner
+        uint8_t _activeLoop;  // Loop _pid points at
+        bool _allLoops;
         SensorCallback _sensorCallback;
         Stream* _serial;  // Pointer to the serial port
+        Print* _out;      // Where messages are written: the port, or _tx when buffered
+        PID_UdpStream* _datagram;  // _serial when it is UDP, sent at the end of update()
+        PID_TxBuffer _tx;
+        size_t _txBudgetBytes;
+        unsigned long _txBudgetMicros;
+        size_t _rxBudget;
         
         // State variables
         bool _enabled;
         bool _running;
+        bool _manual;
+        bool _resuming;  // Controller side: start()'s manual tracking sample is pending
         bool _stepTestActive;
+        bool _stepEnding;
         float _stepTestAmplitude;
         float _originalSetpoint;
         unsigned long _stepTestStartTime;
+        unsigned long _stepTestDuration;
+        
+        // Step response tracking, owned by the controller side while capturing
+        struct StepTracker {
+            StepMetrics metrics;
+            uint32_t start;
+            uint32_t last;
+            float secondsPerTick;
+            float initial;  // pv before the step
+            float span;     // Target minus initial pv
+            float rise10;   // Time the response crossed 10%
+            float peak;     // Largest normalized response
+            bool outside;   // Last sample outside the settling band
+        };
+        StepTracker _step;
+        
+        // Autotune, run by the controller side and polled by the tuner
+        PID_Autotune _autotune;
+        bool _autotuneActive;
+        bool _autotuneApply;
+        
+        // Parameter storage, written by the controller side
+        PID_Storage* _storage;
+        unsigned long _autoSaveDelay;
+        bool _saveDirty;
+        unsigned long _saveChangeTime;
+        bool _saveReport;  // A "save" command waits for its result
+        unsigned long _saveCount;
+        unsigned long _saveWrites;
+        
+        // Step test capture, one sample in _captureStride kept
+        Sample _capture[PID_TUNE_CAPTURE_SIZE];
+        uint16_t _captureCount;
+        unsigned long _captureStride;
+        unsigned long _captureSkip;  // Samples since the last one kept
+        volatile unsigned long _captureDropped;  // Capture queue full in task mode
+        volatile bool _capturing;
+        bool _dumpActive;
+        uint16_t _dumpIndex;
         
         // Timing
         unsigned long _lastDataSend;
-        unsigned long _loopPeriod;
-        static const unsigned long DATA_SEND_INTERVAL = 100;  // Send data at 10Hz
+        unsigned long _loopPeriodUs;
+        unsigned long _dataInterval;
+        bool _adaptiveRate;
+        unsigned long _skippedSamples;
+        int _txCapacity;  // Most free space the port has reported, its TX buffer size
+        
+        // Report by exception, last sample sent per loop
+        struct Report {
+            Sample sent;            // As the host has it, rebuilt from the deltas if sent as such
+            unsigned long keyTime;  // Of the last full frame
+            bool valid;
+        };
+        bool _exception;
+        bool _deltaFrames;
+        float _pvBand;
+        float _outputBand;
+        unsigned long _heartbeat;
+        unsigned long _suppressedSamples;
+        Report _reports[PID_TUNE_REPORT_LOOPS];
         
         // Serial communication
         char _buffer[PID_TUNE_BUFFER_SIZE];
         int _bufferIndex;
         
+        // Command fields, pointing into _buffer (keys are FNV-1a hashes)
+        struct Field {
+            uint32_t key;
+            const char* value;
+        };
+        Field _fields[PID_TUNE_MAX_FIELDS];
+        uint8_t _fieldCount;
+        
+        DataFormat _dataFormat;
+        uint8_t _frameSeq;
+        
+        // Task mode hand-over
+        bool _taskMode;
+        Snapshot _snapshot;
+        unsigned long _lastPublish;
+#if PID_TUNE_HAS_TASK_MODE
+        PID_SpscQueue<Command, PID_TUNE_COMMAND_QUEUE> _commands;
+        PID_SpscSlot<Snapshot> _snapshots;
+        PID_SpscQueue<Sample, PID_TUNE_CAPTURE_QUEUE> _captureQueue;
+#endif
+        
         // Command processing
+        bool parseFields();
+        const char* findField(uint32_t key);
+        bool getFloat(uint32_t key, float& value);
+        bool getULong(uint32_t key, unsigned long& value);
+        bool getBool(uint32_t key, bool& value);
+        uint32_t getStringHash(uint32_t key);
         void processCommand();
         void processSetParams();
         void processSetSP();
@@ -117,13 +504,51 @@ class PID_Tune {
         void processStop();
         void processGetStatus();
         void processStepTest();
+        void processAutotune();
+        void processSetSchedule();
         
         // Data transmission
         void sendData();
+        void sendSample(const Snapshot& state, unsigned long time);
+        void reportSample(const Snapshot& state, unsigned long time);
+        bool sendDelta(Report& report, const Sample& sample, uint8_t loop);
         void sendStatus();
         void sendDebug();
+        void sendFormat();
+        void sendStats();
+        void sendFrame(uint8_t type, const uint8_t* payload, uint8_t length);
+        size_t dataMessageSize();
+        int txSpace();
+        bool txReady(size_t need);
+        void sendCaptureChunk();
+        
+        // Controller access
+        bool apply(uint8_t op, float a = 0.0, float b = 0.0, float c = 0.0, float d = 0.0);
+        bool applyPeriod(uint8_t op, uint32_t period);
+        bool submit(const Command& command);
+        void applyCommand(const Command& command);
+        void endResume();
+        const Snapshot& snapshot(bool readInput = false);
+        void fillSnapshot(Snapshot& snapshot);
+        void fillSnapshot(Snapshot& snapshot, PID_Control& pid, uint8_t loop);
+        
+        // Capture
+        static void onSample(void* context);
+        void captureSample(const Sample& sample);
+        void recordSample(const Sample& sample);
+        void drainCapture();
+        void finishStepTest();
+        void beginStepMetrics(const Sample& baseline, float step);
+        void trackStep(const Sample& sample);
+        void printMetric(float value, int digits);
+        void finishAutotune();
+        void finishSave();
+#if defined(ESP32)
+        static void taskLoop(void* context);
+#endif
         
         // Helper functions
+        void init();
         float readSensor();
         void clearBuffer();
 };
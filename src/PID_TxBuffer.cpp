@@ -0,0 +1,122 @@
+/**************************************************************************************************
+ * PID_TxBuffer - Non-blocking framed transmit buffer
+ * Implementation
+ **************************************************************************************************/
+
+#include "PID_TxBuffer.h"
+
+PID_TxBuffer::PID_TxBuffer() {
+    _buffer = nullptr;
+    _size = 0;
+    _dropped = 0;
+    _portReports = false;
+    clear();
+}
+
+void PID_TxBuffer::attach(uint8_t* buffer, size_t size) {
+    _buffer = size > 1 ? buffer : nullptr;
+    _size = _buffer ? size : 0;
+    _portReports = false;
+    clear();
+}
+
+bool PID_TxBuffer::isAttached() {
+    return _buffer != nullptr;
+}
+
+size_t PID_TxBuffer::write(uint8_t c) {
+    if (!_buffer) return 0;
+    
+    if (!_overflow) {
+        if (used() + 1 < _size) {
+            _buffer[_head] = c;
+            _head = (_head + 1) % _size;
+        } else {
+            _overflow = true;
+        }
+    }
+    
+    // A text line is one message
+    if (c == '\n' && !_inFrame) commit();
+    return 1;
+}
+
+size_t PID_TxBuffer::write(const uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) write(buffer[i]);
+    return size;
+}
+
+int PID_TxBuffer::availableForWrite() {
+    return _buffer ? (int)(_size - 1 - used()) : 0;
+}
+
+void PID_TxBuffer::beginFrame() {
+    _inFrame = true;
+}
+
+bool PID_TxBuffer::endFrame() {
+    _inFrame = false;
+    bool sent = !_overflow;
+    commit();
+    return sent;
+}
+
+size_t PID_TxBuffer::drain(Print& out, size_t maxBytes, unsigned long maxMicros) {
+    unsigned long start = micros();
+    size_t sent = 0;
+    size_t blind = PID_TXBUFFER_BLIND_CHUNK;  // Left for a port that can't report its space
+    
+    while (_tail != _commit) {
+        // Contiguous run up to the commit point or the end of the ring
+        size_t run = (_commit > _tail ? _commit : _size) - _tail;
+        
+        // 0 is a full port once it has reported space; before that it may not be able to tell,
+        // and gets a bounded amount anyway
+        int space = out.availableForWrite();
+        if (space > 0) _portReports = true;
+        bool unknown = space <= 0 && !_portReports;
+        if (unknown) space = (int)blind;
+        if (space <= 0) break;
+        if (run > (size_t)space) run = space;
+        if (maxBytes && run > maxBytes - sent) run = maxBytes - sent;
+        if (run == 0) break;
+        
+        out.write(_buffer + _tail, run);
+        _tail = (_tail + run) % _size;
+        sent += run;
+        if (unknown) blind -= run;
+        
+        if (maxMicros && micros() - start >= maxMicros) break;
+    }
+    return sent;
+}
+
+size_t PID_TxBuffer::pending() {
+    return _buffer ? (_commit + _size - _tail) % _size : 0;
+}
+
+unsigned long PID_TxBuffer::getDroppedFrames() {
+    return _dropped;
+}
+
+void PID_TxBuffer::clear() {
+    _head = 0;
+    _commit = 0;
+    _tail = 0;
+    _inFrame = false;
+    _overflow = false;
+}
+
+void PID_TxBuffer::commit() {
+    if (_overflow) {
+        _head = _commit;  // Roll back the partial message
+        _overflow = false;
+        _dropped++;
+    } else {
+        _commit = _head;
+    }
+}
+
+size_t PID_TxBuffer::used() {
+    return (_head + _size - _tail) % _size;
+}
@@ -0,0 +1,60 @@
+/**************************************************************************************************
+ * PID_TxBuffer - Non-blocking framed transmit buffer
+ * 
+ * A Print that queues output in a caller-supplied ring buffer and sends it later with drain(),
+ * never writing more than the port can take without blocking. Output is committed a message at
+ * a time: a text line on its '\n', a binary frame on endFrame(). A message that doesn't fit is
+ * dropped as a whole and counted, so the receiver only ever sees complete messages.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+// Bytes drain() writes per call to a port that has never reported free space, as Print's default
+// availableForWrite() of 0 doesn't (SoftwareSerial, some USB and network ports): the most a call
+// can block for on such a port
+#ifndef PID_TXBUFFER_BLIND_CHUNK
+#define PID_TXBUFFER_BLIND_CHUNK 16
+#endif
+
+class PID_TxBuffer : public Print {
+    public:
+        PID_TxBuffer();
+        
+        // Use buffer as the ring (nullptr to detach); pending output is discarded
+        void attach(uint8_t* buffer, size_t size);
+        bool isAttached();
+        
+        // Print interface
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t* buffer, size_t size) override;
+        int availableForWrite() override;
+        
+        // Group binary output so a '\n' byte inside it doesn't commit half a frame
+        void beginFrame();
+        bool endFrame();  // false if the frame was dropped
+        
+        // Send committed output to out, limited to what out accepts without blocking and to
+        // maxBytes / maxMicros (0 = no limit). A port that has never reported space since attach()
+        // gets PID_TXBUFFER_BLIND_CHUNK bytes (at most maxBytes) per call. Returns the bytes sent.
+        size_t drain(Print& out, size_t maxBytes = 0, unsigned long maxMicros = 0);
+        
+        size_t pending();  // Committed bytes not sent yet
+        unsigned long getDroppedFrames();
+        void clear();
+        
+    private:
+        void commit();
+        size_t used();
+        
+        uint8_t* _buffer;
+        size_t _size;
+        size_t _head;    // Next write
+        size_t _commit;  // End of complete messages
+        size_t _tail;    // Next byte to send
+        bool _inFrame;
+        bool _overflow;     // Current message didn't fit
+        bool _portReports;  // The port has reported free space, so 0 means full
+        unsigned long _dropped;
+};
@@ -0,0 +1,128 @@
+/**************************************************************************************************
+ * PID_UdpStream - PID_Tune over UDP
+ * Implementation
+ **************************************************************************************************/
+
+#include "PID_UdpStream.h"
+
+PID_UdpStream::PID_UdpStream(UDP& udp) : _udp(udp) {
+    _destinationPort = 0;
+    _haveDestination = false;
+    _fixedDestination = false;
+    _length = 0;
+    _sequence = 0;
+    _packets = 0;
+    _sendErrors = 0;
+    _rxRemaining = 0;
+    _rxEnd = false;
+}
+
+void PID_UdpStream::setDestination(IPAddress ip, uint16_t port) {
+    _destination = ip;
+    _destinationPort = port;
+    _haveDestination = true;
+    _fixedDestination = true;
+}
+
+void PID_UdpStream::send() {
+    if (_length <= PID_UDP_HEADER_SIZE) return;
+    
+    // Without a destination there is nobody to send to yet, the output is dropped
+    if (_haveDestination) {
+        _packet[0] = PID_UDP_SYNC;
+        _packet[1] = PID_UDP_VERSION;
+        _packet[2] = (uint8_t)(_sequence & 0xFF);
+        _packet[3] = (uint8_t)(_sequence >> 8);
+        
+        bool sent = _udp.beginPacket(_destination, _destinationPort) &&
+                    _udp.write(_packet, _length) == _length &&
+                    _udp.endPacket();
+        if (sent) {
+            _packets++;
+        } else {
+            _sendErrors++;
+        }
+        _sequence++;
+    }
+    _length = 0;
+}
+
+uint16_t PID_UdpStream::getSequence() {
+    return _sequence;
+}
+
+unsigned long PID_UdpStream::getPackets() {
+    return _packets;
+}
+
+unsigned long PID_UdpStream::getSendErrors() {
+    return _sendErrors;
+}
+
+// Start reading the next received datagram, remembering who to answer
+bool PID_UdpStream::nextPacket() {
+    int size = _udp.parsePacket();
+    if (size <= 0) return false;
+    
+    // Replies go back to the sender unless a destination was set
+    if (!_fixedDestination) {
+        _destination = _udp.remoteIP();
+        _destinationPort = _udp.remotePort();
+        _haveDestination = true;
+    }
+    _rxRemaining = size;
+    _rxEnd = true;
+    return true;
+}
+
+int PID_UdpStream::available() {
+    if (_rxRemaining == 0 && !_rxEnd) nextPacket();
+    return _rxRemaining + (_rxEnd ? 1 : 0);
+}
+
+int PID_UdpStream::read() {
+    if (_rxRemaining == 0 && !_rxEnd && !nextPacket()) return -1;
+    
+    if (_rxRemaining > 0) {
+        _rxRemaining--;
+        return _udp.read();
+    }
+    // Every datagram ends a command
+    _rxEnd = false;
+    return '\n';
+}
+
+int PID_UdpStream::peek() {
+    if (_rxRemaining == 0 && !_rxEnd && !nextPacket()) return -1;
+    return _rxRemaining > 0 ? _udp.peek() : '\n';
+}
+
+size_t PID_UdpStream::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t PID_UdpStream::write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        if (_length == 0) _length = PID_UDP_HEADER_SIZE;
+        if (_length == PID_UDP_PACKET_SIZE) {
+            send();
+            continue;
+        }
+        
+        size_t chunk = PID_UDP_PACKET_SIZE - _length;
+        if (chunk > size - written) chunk = size - written;
+        memcpy(_packet + _length, buffer + written, chunk);
+        _length += chunk;
+        written += chunk;
+    }
+    return written;
+}
+
+int PID_UdpStream::availableForWrite() {
+    return PID_UDP_PACKET_SIZE - (_length > PID_UDP_HEADER_SIZE ? _length : PID_UDP_HEADER_SIZE);
+}
+
+void PID_UdpStream::flush() {
+    send();
+}
@@ -0,0 +1,79 @@
+/**************************************************************************************************
+ * PID_UdpStream - PID_Tune over UDP
+ * 
+ * A Stream on top of any Arduino UDP socket (WiFiUDP, EthernetUDP), so one tuning station can
+ * watch and tune many networked nodes:
+ * 
+ *     WiFiUDP udp;
+ *     PID_UdpStream link(udp);
+ * 
+ *     udp.beginMulticast(IPAddress(239, 0, 0, 57), 5700);  // Or udp.begin(5700)
+ *     link.setDestination(IPAddress(239, 0, 0, 57), 5700);  // Every observer gets the telemetry
+ *     tuner.begin(link);
+ * 
+ * Everything PID_Tune writes during one update() goes out as one datagram (or more, if it
+ * doesn't fit PID_UDP_PACKET_SIZE). Each datagram starts with a 4 byte header: sync byte,
+ * version and a 16-bit little-endian sequence number, so receivers can spot lost datagrams.
+ * The rest is the usual JSON lines or binary frames; a message can continue in the next
+ * datagram. Received datagrams are commands, one per datagram, with or without the newline.
+ * Until setDestination() is called, output goes to whoever sent the last command.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <Udp.h>
+
+// Datagram size including the header; keep it under the path MTU (1472 on Ethernet/WiFi)
+#ifndef PID_UDP_PACKET_SIZE
+#define PID_UDP_PACKET_SIZE 512
+#endif
+
+#define PID_UDP_SYNC 0xA6
+#define PID_UDP_VERSION 1
+#define PID_UDP_HEADER_SIZE 4
+
+class PID_UdpStream : public Stream {
+    public:
+        // The socket is opened (begin() or beginMulticast()) by the sketch
+        PID_UdpStream(UDP& udp);
+        
+        // Where datagrams go: a host or a multicast group
+        void setDestination(IPAddress ip, uint16_t port);
+        
+        // Send what has been written as one datagram; PID_Tune calls this after each update()
+        void send();
+        
+        uint16_t getSequence();        // Of the next datagram
+        unsigned long getPackets();    // Datagrams sent
+        unsigned long getSendErrors(); // Datagrams the socket refused
+        
+        // Stream
+        int available() override;
+        int read() override;
+        int peek() override;
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t* buffer, size_t size) override;
+        int availableForWrite() override;  // Room left in the current datagram
+        void flush() override;             // Same as send()
+        using Print::write;
+        
+    private:
+        bool nextPacket();
+        
+        UDP& _udp;
+        IPAddress _destination;
+        uint16_t _destinationPort;
+        bool _haveDestination;
+        bool _fixedDestination;  // Set by setDestination(), not by the last sender
+        
+        uint8_t _packet[PID_UDP_PACKET_SIZE];
+        size_t _length;
+        uint16_t _sequence;
+        unsigned long _packets;
+        unsigned long _sendErrors;
+        
+        // Received command
+        int _rxRemaining;
+        bool _rxEnd;  // A newline is still to be returned after the datagram
+};
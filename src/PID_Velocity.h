@@ -0,0 +1,25 @@
+/**************************************************************************************************
+ * PID_Velocity - Velocity-form (incremental) PID step
+ * 
+ * Shared by PID_Control, PID_ControlT and PID_Bank. Instead of an integral accumulator the
+ * controller keeps its last output and adds, each sample,
+ * 
+ *     du = Kp*(e - e1) + Ki*Ts*e - Kd/Ts*(y - 2*y1 + y2)
+ * 
+ * with the derivative on measurement. Clamping the output is then the anti-windup, and gain
+ * changes don't bump the output. Templated so float and q16_16 share it. Header-only.
+ **************************************************************************************************/
+
+#pragma once
+
+// y - 2*y1 + y2, as two differences so fixed point doesn't overflow on 2*y1
+template <typename T>
+inline T pidSecondDifference(T input, T prevInput, T prevInput2) {
+    return (input - prevInput) - (prevInput - prevInput2);
+}
+
+// Output change for one sample, Ki and Kd already scaled by the sample time
+template <typename T>
+inline T pidVelocityDelta(T Kp, T KiTs, T KdTs, T error, T prevError, T input, T prevInput, T prevInput2) {
+    return Kp * (error - prevError) + KiTs * error - KdTs * pidSecondDifference(input, prevInput, prevInput2);
+}